@@ -0,0 +1,69 @@
+#include "affine-transform.h"
+#include <cmath>
+#include <numbers>
+
+AffineTransform AffineTransform::rotation(double theta, bool degrees/*=true*/) {
+  if (degrees) { // converts to radians
+    theta *= std::numbers::pi / 180;
+  }
+
+  AffineTransform transform;
+  transform.a = std::cos(theta);
+  transform.b = -std::sin(theta);
+  transform.d = std::sin(theta);
+  transform.e = std::cos(theta);
+  return transform;
+}
+
+AffineTransform AffineTransform::scaling(double scaleX, double scaleY) {
+  AffineTransform transform;
+  transform.a = scaleX;
+  transform.e = scaleY;
+  return transform;
+}
+
+AffineTransform AffineTransform::shear(double shearX, double shearY) {
+  AffineTransform transform;
+  transform.b = shearX;
+  transform.d = shearY;
+  return transform;
+}
+
+AffineTransform AffineTransform::translation(double offsetX, double offsetY) {
+  AffineTransform transform;
+  transform.c = offsetX;
+  transform.f = offsetY;
+  return transform;
+}
+
+AffineTransform AffineTransform::then(const AffineTransform& next) const {
+  AffineTransform combined;
+  combined.a = next.a * a + next.b * d;
+  combined.b = next.a * b + next.b * e;
+  combined.c = next.a * c + next.b * f + next.c;
+  combined.d = next.d * a + next.e * d;
+  combined.e = next.d * b + next.e * e;
+  combined.f = next.d * c + next.e * f + next.f;
+  return combined;
+}
+
+bool AffineTransform::isInvertible() const {
+  return std::abs(a * e - b * d) > 1e-12;
+}
+
+AffineTransform AffineTransform::inverse() const {
+  double determinant = a * e - b * d;
+
+  AffineTransform inverted;
+  inverted.a = e / determinant;
+  inverted.b = -b / determinant;
+  inverted.d = -d / determinant;
+  inverted.e = a / determinant;
+  inverted.c = -(inverted.a * c + inverted.b * f);
+  inverted.f = -(inverted.d * c + inverted.e * f);
+  return inverted;
+}
+
+std::array<double, 2> AffineTransform::apply(double x, double y) const {
+  return {a * x + b * y + c, d * x + e * y + f};
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <array>
+
+// 2x3 matrix mapping image coordinates (x is the column, y the row) to new ones
+// x' = a * x + b * y + c
+// y' = d * x + e * y + f
+struct AffineTransform {
+  double a = 1, b = 0, c = 0;
+  double d = 0, e = 1, f = 0;
+
+  // positive angles turn clockwise on screen since y points down
+  static AffineTransform rotation(double theta, bool degrees=true);
+  static AffineTransform scaling(double scaleX, double scaleY);
+  static AffineTransform shear(double shearX, double shearY);
+  static AffineTransform translation(double offsetX, double offsetY);
+
+  // applies this transform, then next
+  AffineTransform then(const AffineTransform& next) const;
+  bool isInvertible() const;
+  AffineTransform inverse() const;
+
+  std::array<double, 2> apply(double x, double y) const;
+};
@@ -0,0 +1,111 @@
+#include "image-processor.h"
+#include "pipeline.h"
+#include "buffer-pool.h"
+#include "staged-batch.h"
+#include <thread>
+#include <cmath>
+
+using std::vector;
+using std::string;
+
+void printUsage() {
+  std::cerr << "Usage: batch <input dir> <output dir> \"<operations>\" [--threads n] [--readers n] [--writers n] [--queue n] [--memory mb]" << std::endl;
+  std::cerr << "  operations are separated by ';', e.g. \"grayscale; blur mean 3; threshold 100\"" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 4) {
+    printUsage();
+    return 1;
+  }
+
+  std::filesystem::path inputDir = argv[1];
+  std::filesystem::path outputDir = argv[2];
+  StagedBatch::Options options;
+  options.workers = std::max(1u, std::thread::hardware_concurrency());
+  size_t memoryLimit = 1024;
+
+  for (int i = 4; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--threads" && i + 1 < argc) {
+      options.workers = std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "--readers" && i + 1 < argc) {
+      options.readers = std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "--writers" && i + 1 < argc) {
+      options.writers = std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "--queue" && i + 1 < argc) {
+      options.queueDepth = std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "--memory" && i + 1 < argc) {
+      memoryLimit = std::max(1, std::atoi(argv[++i]));
+    }
+    else {
+      printUsage();
+      return 1;
+    }
+  }
+
+  Pipeline pipeline;
+  if (!pipeline.parse(argv[3])) {
+    return 1;
+  }
+
+  if (!std::filesystem::is_directory(inputDir)) {
+    std::cerr << "Error: " << inputDir << " is not a directory" << std::endl;
+    return 1;
+  }
+
+  vector<std::filesystem::path> files;
+  for (const auto& entry : std::filesystem::directory_iterator(inputDir)) {
+    string extension = entry.path().extension().string();
+    if (entry.is_regular_file() && (extension == ".ppm" || extension == ".pgm" || extension == ".pnm")) {
+      files.push_back(entry.path());
+    }
+  }
+  std::sort(files.begin(), files.end());
+
+  options.memoryLimit = memoryLimit * 1024 * 1024;
+  // idle threads keep their filters' scratch buffers for the next file, up to their share of the budget
+  int numThreads = options.readers + options.workers + options.writers;
+  BufferPool::setLimits(4, options.memoryLimit / numThreads);
+
+  StagedBatch batch(options);
+  vector<StagedBatch::FileResult> results = batch.run(files, outputDir, pipeline);
+  double seconds = batch.getWallSeconds();
+
+  int succeeded = 0;
+  long long pixels = 0;
+  for (const StagedBatch::FileResult& result : results) {
+    if (result.succeeded) {
+      succeeded++;
+      pixels += result.pixels;
+    }
+    else {
+      std::cerr << "Error: " << result.file << ": " << result.error << std::endl;
+    }
+  }
+
+  std::cout << "Processed " << succeeded << "/" << files.size() << " files in " << seconds << " s" << std::endl;
+  std::cout << "  " << succeeded / seconds << " files/s, " << pixels / seconds / 1e6 << " Mpixel/s" << std::endl;
+  BufferPool::Stats bufferStats = BufferPool::getStats();
+  std::cout << "  " << bufferStats.allocations << " scratch buffers allocated (" << bufferStats.bytesAllocated / 1e6 << " MB), ";
+  std::cout << bufferStats.reuses << " reused" << std::endl;
+  // the share of each stage's thread time spent working, waiting for input and held back by the next stage
+  for (const StagedBatch::StageStats& stage : batch.getStats()) {
+    std::cout << "  " << stage.name << ": " << stage.threads << (stage.threads == 1 ? " thread, " : " threads, ");
+    std::cout << std::round(stage.busy(seconds) * 100) << "% busy, ";
+    std::cout << std::round(stage.starved(seconds) * 100) << "% waiting for input, ";
+    std::cout << std::round(stage.blocked(seconds) * 100) << "% held back" << std::endl;
+  }
+  if (!files.empty()) {
+    std::cout << "  bottleneck: " << batch.bottleneck().name << std::endl;
+  }
+  if (succeeded != files.size()) {
+    std::cout << "  " << files.size() - succeeded << " failed" << std::endl;
+    return 1;
+  }
+  return 0;
+}
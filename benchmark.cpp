@@ -0,0 +1,454 @@
+#include "image-processor.h"
+#include "pipeline.h"
+#include "simd-kernels.h"
+#include "buffer-pool.h"
+#include <chrono>
+
+using std::vector;
+using std::string;
+
+struct BenchResult {
+  string name;
+  int numChannels;
+  double megapixels;
+  double medianMs;
+  double minMs;
+  double meanMs;
+  double stddevMs;
+  // scratch buffers allocated per timed repetition, 0 once the buffer pool is warm
+  double allocations = 0;
+};
+
+struct BenchOptions {
+  vector<double> sizes = {1, 4, 16};
+  int warmups = 1;
+  int repetitions = 5;
+  string filter;
+  std::filesystem::path outputPath;
+  std::filesystem::path baselinePath;
+  double tolerance = 10;
+};
+
+void printUsage() {
+  std::cerr << "Usage: benchmark [--sizes 1,4,16,100] [--reps n] [--warmup n] [--filter name]" << std::endl;
+  std::cerr << "                 [--output results.csv] [--baseline results.csv] [--tolerance percent]" << std::endl;
+}
+
+// deterministic noisy gradient so sorting and thresholding do real work
+vector<unsigned char> syntheticPixels(int width, int height, int numChannels) {
+  vector<unsigned char> pixels(width * height * numChannels);
+  uint32_t state = 12345;
+
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      for (int channel = 0; channel < numChannels; channel++) {
+        state = state * 1664525 + 1013904223;
+        int gradient = (row * 255 / height + col * 255 / width + channel * 85) / 2;
+        pixels[(width * row + col) * numChannels + channel] = (gradient + (state >> 27)) & 255;
+      }
+    }
+  }
+  return pixels;
+}
+
+BenchResult summarize(const string& name, int numChannels, double megapixels, vector<double> times) {
+  std::sort(times.begin(), times.end());
+
+  double mean = 0;
+  for (double time : times) {
+    mean += time;
+  }
+  mean /= times.size();
+
+  double variance = 0;
+  for (double time : times) {
+    variance += (time - mean) * (time - mean);
+  }
+
+  double median = times[times.size() / 2];
+  if (times.size() % 2 == 0) {
+    median = (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+  }
+
+  return {name, numChannels, megapixels, median, times.front(), mean, std::sqrt(variance / times.size())};
+}
+
+// setup runs untimed before every repetition, usually copying the source image
+BenchResult measure(const string& name, int numChannels, double megapixels, const BenchOptions& options,
+                    const std::function<void()>& setup, const std::function<void()>& operation) {
+  vector<double> times;
+  long long allocations = 0;
+
+  for (int i = 0; i < options.warmups + options.repetitions; i++) {
+    setup();
+    long long allocationsBefore = BufferPool::getStats().allocations;
+    auto start = std::chrono::steady_clock::now();
+    operation();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (i >= options.warmups) {
+      times.push_back(ms);
+      allocations += BufferPool::getStats().allocations - allocationsBefore;
+    }
+  }
+  BenchResult result = summarize(name, numChannels, megapixels, times);
+  result.allocations = (double)allocations / options.repetitions;
+  return result;
+}
+
+void printResult(std::ostream& out, const BenchResult& result) {
+  out << result.name << "," << result.numChannels << "," << result.megapixels << ","
+      << result.medianMs << "," << result.minMs << "," << result.meanMs << "," << result.stddevMs << ","
+      << result.megapixels / (result.medianMs / 1000) << "," << result.allocations << std::endl;
+}
+
+vector<BenchResult> loadResults(const std::filesystem::path& path) {
+  vector<BenchResult> results;
+  std::ifstream fin(path);
+  string line;
+
+  std::getline(fin, line); // header
+  while (std::getline(fin, line)) {
+    std::stringstream fields(line);
+    BenchResult result;
+    string field;
+
+    std::getline(fields, result.name, ',');
+    std::getline(fields, field, ',');
+    result.numChannels = std::stoi(field);
+    std::getline(fields, field, ',');
+    result.megapixels = std::stod(field);
+    std::getline(fields, field, ',');
+    result.medianMs = std::stod(field);
+    results.push_back(result);
+  }
+  return results;
+}
+
+// compares medians, returns how many benchmarks slowed down by more than the tolerance
+int compareToBaseline(const vector<BenchResult>& results, const BenchOptions& options) {
+  vector<BenchResult> baseline = loadResults(options.baselinePath);
+  int regressions = 0;
+
+  for (const BenchResult& result : results) {
+    for (const BenchResult& base : baseline) {
+      if (base.name != result.name || base.numChannels != result.numChannels || base.megapixels != result.megapixels) {
+        continue;
+      }
+
+      double change = (result.medianMs - base.medianMs) / base.medianMs * 100;
+      if (change > options.tolerance) {
+        std::cerr << "Regression: " << result.name << " (" << result.numChannels << " channels, " << result.megapixels
+                  << " MP) " << base.medianMs << " ms -> " << result.medianMs << " ms (+" << change << "%)" << std::endl;
+        regressions++;
+      }
+    }
+  }
+  return regressions;
+}
+
+bool parseOptions(int argc, char* argv[], BenchOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (i + 1 >= argc) {
+      return false;
+    }
+
+    if (arg == "--sizes") {
+      options.sizes.clear();
+      std::stringstream sizes(argv[++i]);
+      string size;
+      while (std::getline(sizes, size, ',')) {
+        options.sizes.push_back(std::stod(size));
+      }
+    }
+    else if (arg == "--reps") {
+      options.repetitions = std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "--warmup") {
+      options.warmups = std::max(0, std::atoi(argv[++i]));
+    }
+    else if (arg == "--filter") {
+      options.filter = argv[++i];
+    }
+    else if (arg == "--output") {
+      options.outputPath = argv[++i];
+    }
+    else if (arg == "--baseline") {
+      options.baselinePath = argv[++i];
+    }
+    else if (arg == "--tolerance") {
+      options.tolerance = std::atof(argv[++i]);
+    }
+    else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// runs every SIMD variant the CPU supports against the scalar kernels, returns the number of mismatches
+int verifySimdKernels() {
+  const int NUM_PIXELS = 100003; // not a multiple of any vector width, so the scalar tails run too
+  vector<unsigned char> source = syntheticPixels(NUM_PIXELS, 1, 3);
+  int mismatches = 0;
+
+  auto runKernel = [&](const PixelKernels& kernels, const string& name) {
+    vector<unsigned char> pixels = source;
+    if (name == "grayscale709") {
+      kernels.grayscale(pixels.data(), pixels.data(), NUM_PIXELS, 709);
+      pixels.resize(NUM_PIXELS);
+    }
+    else if (name == "grayscale601") {
+      kernels.grayscale(pixels.data(), pixels.data(), NUM_PIXELS, 601);
+      pixels.resize(NUM_PIXELS);
+    }
+    else if (name == "brightness") {
+      kernels.grayscale(pixels.data(), pixels.data(), NUM_PIXELS, 0);
+      pixels.resize(NUM_PIXELS);
+    }
+    else if (name == "invert") {
+      kernels.invert(pixels.data(), pixels.size(), 255);
+    }
+    else if (name == "sepia") {
+      kernels.sepia(pixels.data(), NUM_PIXELS);
+    }
+    else if (name == "tint") {
+      kernels.tint(pixels.data(), NUM_PIXELS, 1.0f, 0.8f, 0.3f, 1.4f);
+    }
+    else if (name == "threshold") {
+      kernels.threshold(pixels.data(), pixels.size(), 100);
+    }
+    else if (name == "channelSwap") {
+      kernels.channelSwap(pixels.data(), NUM_PIXELS, 0, 2);
+    }
+    else if (name == "reverse") {
+      kernels.reverse(pixels.data(), NUM_PIXELS, 3);
+    }
+    else if (name == "reverseGray") {
+      kernels.reverse(pixels.data(), pixels.size(), 1);
+    }
+    return pixels;
+  };
+
+  const PixelKernels& scalar = SimdKernels::get(SimdLevel::SCALAR);
+  for (SimdLevel level : {SimdLevel::SSE41, SimdLevel::AVX2}) {
+    if (level > SimdKernels::detectLevel()) {
+      continue;
+    }
+
+    for (string name : {"grayscale709", "grayscale601", "brightness", "invert", "sepia", "tint", "threshold", "channelSwap", "reverse", "reverseGray"}) {
+      if (runKernel(SimdKernels::get(level), name) != runKernel(scalar, name)) {
+        std::cerr << "Error: " << SimdKernels::levelName(level) << " " << name << " differs from scalar" << std::endl;
+        mismatches++;
+      }
+    }
+  }
+  return mismatches;
+}
+
+// runs a large flat disk through the fixed-point direct convolution in every border mode and compares it with
+// a double-precision sum, returns the number of modes that are off by more than one level
+int verifyConvolution(const std::filesystem::path& benchDir) {
+  const int WIDTH = 97;
+  const int HEIGHT = 61;
+  const int RADIUS = 20;
+  std::filesystem::path sourcePath = benchDir / "convolution.ppm";
+  vector<unsigned char> source = syntheticPixels(WIDTH, HEIGHT, 3);
+  PNM writer;
+  writer.write(sourcePath, source, WIDTH, HEIGHT, 255, 3);
+  ConvolutionKernel kernel = ConvolutionKernel::disk(RADIUS);
+  int size = kernel.getWidth();
+
+  auto borderIndex = [](int i, int n, const string& mode) {
+    if (i >= 0 && i < n) {
+      return i;
+    }
+    if (mode == "zero") {
+      return -1;
+    }
+    if (mode == "wrap") {
+      return (i % n + n) % n;
+    }
+    if (mode == "reflect") {
+      int period = 2 * n;
+      i = (i % period + period) % period;
+      return i < n ? i : period - 1 - i;
+    }
+    return std::clamp(i, 0, n - 1);
+  };
+
+  int mismatches = 0;
+  for (string mode : {"clamp", "reflect", "wrap", "zero"}) {
+    PNM img(sourcePath);
+    img.convolve(kernel, mode, "direct");
+    ImageView result = img.view();
+
+    int worst = 0;
+    for (int row = 0; row < HEIGHT; row++) {
+      for (int col = 0; col < WIDTH; col++) {
+        for (int channel = 0; channel < 3; channel++) {
+          double sum = 0;
+          for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+              int sourceRow = borderIndex(row + y - RADIUS, HEIGHT, mode);
+              int sourceCol = borderIndex(col + x - RADIUS, WIDTH, mode);
+              if (sourceRow >= 0 && sourceCol >= 0) {
+                sum += kernel.at(y, x) * source[(sourceRow * WIDTH + sourceCol) * 3 + channel];
+              }
+            }
+          }
+          int expected = std::clamp((int)std::lround(sum), 0, 255);
+          worst = std::max(worst, std::abs(result.row(row)[col * 3 + channel] - expected));
+        }
+      }
+    }
+    if (worst > 1) {
+      std::cerr << "Error: direct disk convolution with " << mode << " borders is off by " << worst << " levels" << std::endl;
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+int main(int argc, char* argv[]) {
+  BenchOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage();
+    return 1;
+  }
+
+  std::cerr << "SIMD level: " << SimdKernels::levelName(SimdKernels::getLevel()) << std::endl;
+  if (verifySimdKernels() > 0) {
+    return 1;
+  }
+
+  std::filesystem::path benchDir = std::filesystem::temp_directory_path() / "pnm-benchmark";
+  std::filesystem::create_directories(benchDir);
+  if (verifyConvolution(benchDir) > 0) {
+    return 1;
+  }
+
+  const string HEADER = "name,channels,megapixels,median_ms,min_ms,mean_ms,stddev_ms,mpixels_per_s,allocations";
+  std::cout << HEADER << std::endl;
+  vector<BenchResult> results;
+
+  for (double megapixels : options.sizes) {
+    // 4:3 images, dimensions kept divisible by 4 so halving scales are exact
+    int width = std::sqrt(megapixels * 1e6 * 4 / 3);
+    int height = megapixels * 1e6 / width;
+    width -= width % 4;
+    height -= height % 4;
+
+    for (int numChannels : {1, 3}) {
+      std::filesystem::path sourcePath = benchDir / (numChannels == 3 ? "source.ppm" : "source.pgm");
+      PNM writer;
+      writer.write(sourcePath, syntheticPixels(width, height, numChannels), width, height, 255, numChannels);
+
+      PNM source(sourcePath);
+      PNM img;
+      auto copySource = [&] { img = source; };
+
+      auto bench = [&](const string& name, const std::function<void()>& operation) {
+        if (!options.filter.empty() && name.find(options.filter) == string::npos) {
+          return;
+        }
+        results.push_back(measure(name, numChannels, megapixels, options, copySource, operation));
+        printResult(std::cout, results.back());
+      };
+
+      // io
+      bench("read", [&] { img.read(sourcePath); });
+      bench("readMapped", [&] { img.read(sourcePath, true); });
+      bench("write", [&] { img.write(benchDir / "output"); });
+      bench("writeMapped", [&] { img.write(benchDir / "output", true); });
+      bench("writeView", [&] { img.write(benchDir / (numChannels == 3 ? "view.ppm" : "view.pgm"), img.view({height / 4, width / 4}, width / 2, height / 2)); });
+
+      // filters
+      bench("grayscale", [&] { img.grayscale(); });
+      bench("invertColor", [&] { img.invertColor(); });
+      bench("sepia", [&] { img.sepia(); });
+      bench("tint", [&] { img.tint(255, 200, 150); });
+      bench("threshold", [&] { img.threshold(100); });
+      bench("channelSwap", [&] { img.channelSwap('r', 'b'); });
+      bench("noise", [&] { img.noise("salt", 0.05, 1); });
+      bench("noiseGaussian", [&] { img.noise("gaussian", 10, 1); });
+      bench("noiseUniform", [&] { img.noise("uniform", 20, 1); });
+      bench("blurMean3", [&] { img.blur("mean", 3); });
+      bench("blurMean25", [&] { img.blur("mean", 25); });
+      bench("blurGaussian3", [&] { img.blur("gaussian", 3); });
+      bench("blurGaussian25", [&] { img.blur("gaussian", 25); });
+      bench("blurFastGaussian25", [&] { img.blur("fastGaussian", 25); });
+      bench("blurMedian3", [&] { img.blur("median", 3); });
+      bench("blurMedian25", [&] { img.blur("median", 25); });
+      bench("sharpen", [&] { img.sharpen(1.5, 3); });
+      bench("convolveSobel", [&] { img.convolve(ConvolutionKernel::sobelX()); });
+      bench("convolveGaussian7", [&] { img.convolve(ConvolutionKernel::gaussian(7)); });
+      bench("convolve5x5", [&] { img.convolve(ConvolutionKernel(5, 5, {0, 0, -1, 0, 0, 0, -1, -2, -1, 0, -1, -2, 16, -2, -1, 0, -1, -2, -1, 0, 0, 0, -1, 0, 0})); });
+      bench("convolveDisk15", [&] { img.convolve(ConvolutionKernel::disk(15)); });
+      bench("convolveDisk15Direct", [&] { img.convolve(ConvolutionKernel::disk(15), "clamp", "direct"); });
+      bench("chromaShift", [&] { img.chromaShift(20, 0, -20, 50); });
+      bench("gamma", [&] { img.gamma(2.2); });
+      bench("curves", [&] { img.curves({{0, 0}, {128, 160}, {255, 255}}); });
+      bench("hueSaturation", [&] { img.hueSaturation(30, 1.2); });
+      bench("colorPlanesHSV", [&] { img.fromColorPlanes(img.toColorPlanes(ColorSpace::HSV)); });
+      bench("histogram", [&] { img.histogram(); });
+      bench("thresholdOtsu", [&] { img.threshold("otsu"); });
+      bench("equalize", [&] { img.equalize(); });
+      bench("clahe", [&] { img.clahe(); });
+
+      // warps
+      bench("verticalFlip", [&] { img.verticalFlip(); });
+      bench("horizontalFlip", [&] { img.horizontalFlip(); });
+      bench("verticalReflection", [&] { img.verticalReflection(); });
+      bench("horizontalReflection", [&] { img.horizontalReflection(); });
+      bench("rectCrop", [&] { img.rectCrop({height / 4, width / 4}, width / 2, height / 2); });
+      bench("combinedReflection", [&] { img.combinedReflection(); });
+      bench("rotate90", [&] { img.rotate90(); });
+      bench("rotate180", [&] { img.rotate90(2); });
+      bench("transpose", [&] { img.transpose(); });
+      bench("rotate", [&] { img.rotate(30); });
+      bench("rotateBilinear", [&] { img.rotate(30, true, "bilinear"); });
+      bench("shear", [&] { img.shear(0.3, 0); });
+      bench("scale", [&] { img.scale(0.5, 0.5); });
+      bench("scaleBilinear", [&] { img.scale(0.5, 0.5, "bilinear"); });
+      bench("scaleLanczos3", [&] { img.scale(0.5, 0.5, "lanczos3"); });
+      bench("scaleUpBicubic", [&] { img.scale(1.5, 1.5, "bicubic"); });
+      bench("thumbnailArea", [&] { img.scale(0.05, 0.05, "area"); });
+      bench("pixelSort", [&] { img.pixelSort('l', "brightness"); });
+      bench("pixelSortColumns", [&] { img.pixelSort('d', "luminance"); });
+      bench("pixelSortSpans", [&] { img.pixelSort('r', "brightness", true, 60, 200); });
+      bench("pixelSortHue", [&] { img.pixelSort('r', "hue"); });
+
+      // fused point operations
+      Pipeline pipeline;
+      pipeline.tint(255, 200, 150).grayscale().invertColor().threshold(100);
+      bench("pipelineFused", [&] { pipeline.run(img); });
+
+      // tone operations composed into one lookup table
+      Pipeline tonePipeline;
+      tonePipeline.invertColor().gamma(2.2).brightnessContrast(10, 1.2).tint(255, 200, 150);
+      bench("pipelineLUT", [&] { tonePipeline.run(img); });
+      bench("pipelineRegion", [&] { tonePipeline.run(img.view({height / 4, width / 4}, width / 2, height / 2)); });
+    }
+  }
+
+  if (!options.outputPath.empty()) {
+    std::ofstream fout(options.outputPath);
+    fout << HEADER << std::endl;
+    for (const BenchResult& result : results) {
+      printResult(fout, result);
+    }
+  }
+
+  std::filesystem::remove_all(benchDir);
+
+  if (!options.baselinePath.empty()) {
+    int regressions = compareToBaseline(results, options);
+    if (regressions > 0) {
+      std::cerr << regressions << " benchmark(s) slower than the baseline by more than " << options.tolerance << "%" << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// fixed-capacity multi-producer multi-consumer queue (vyukov's ring), pushes and pops claim a cell with one
+// compare-and-swap and never take a lock
+// the blocking push and pop sleep on the push and pop counts with atomic wait, so a full queue holds its
+// producers back and an empty one parks its consumers without spinning
+template <typename T>
+class BoundedQueue {
+private:
+  struct Cell {
+    // position + 1 once a value is in the cell, position + capacity once it's been taken
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells;
+  size_t mask;
+  alignas(64) std::atomic<size_t> enqueuePosition{0};
+  alignas(64) std::atomic<size_t> dequeuePosition{0};
+  alignas(64) std::atomic<uint32_t> pushes{0};
+  std::atomic<uint32_t> pops{0};
+  std::atomic<bool> closed{false};
+
+  void notify(std::atomic<uint32_t>& count) {
+    count++;
+    count.notify_all();
+  }
+
+public:
+  // capacity is rounded up to a power of two
+  explicit BoundedQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size *= 2;
+    }
+    cells = std::make_unique<Cell[]>(size);
+    mask = size - 1;
+    for (size_t i = 0; i < size; i++) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+  // moves value in and returns true, or returns false and leaves it if the queue is full
+  bool tryPush(T& value) {
+    size_t position = enqueuePosition.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &cells[position & mask];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+      if (difference == 0) {
+        if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      }
+      else if (difference < 0) {
+        return false;
+      }
+      else {
+        position = enqueuePosition.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->value = std::move(value);
+    cell->sequence.store(position + 1, std::memory_order_release);
+    notify(pushes);
+    return true;
+  }
+
+  // returns false if the queue is empty
+  bool tryPop(T& value) {
+    size_t position = dequeuePosition.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &cells[position & mask];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+      if (difference == 0) {
+        if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      }
+      else if (difference < 0) {
+        return false;
+      }
+      else {
+        position = dequeuePosition.load(std::memory_order_relaxed);
+      }
+    }
+
+    value = std::move(cell->value);
+    cell->sequence.store(position + mask + 1, std::memory_order_release);
+    notify(pops);
+    return true;
+  }
+
+  // waits for room, returns false without pushing if the queue has been closed
+  bool push(T value) {
+    while (true) {
+      // read before trying, so a pop between the try and the wait ends the wait straight away
+      uint32_t seenPops = pops.load();
+      if (closed.load()) {
+        return false;
+      }
+      if (tryPush(value)) {
+        return true;
+      }
+      pops.wait(seenPops);
+    }
+  }
+
+  // waits for a value, returns false once the queue is closed and empty
+  bool pop(T& value) {
+    while (true) {
+      uint32_t seenPushes = pushes.load();
+      if (tryPop(value)) {
+        return true;
+      }
+      if (closed.load()) {
+        // pushes made before closing are visible now
+        return tryPop(value);
+      }
+      pushes.wait(seenPushes);
+    }
+  }
+
+  // no more pushes, consumers drain what's left and then stop
+  void close() {
+    closed.store(true);
+    notify(pushes);
+    notify(pops);
+  }
+};
@@ -0,0 +1,117 @@
+#include "buffer-pool.h"
+#include "instrumentation.h"
+#include <algorithm>
+#include <atomic>
+
+using std::vector;
+
+static std::atomic<int> maxBuffers{4};
+static std::atomic<size_t> maxBytes{(size_t)1 << 30};
+
+static std::atomic<long long> allocations{0};
+static std::atomic<long long> bytesAllocated{0};
+static std::atomic<long long> reuses{0};
+static std::atomic<long long> bytesHeld{0};
+
+// buffers can be dropped during thread exit after the pool is gone, they're just freed then
+static thread_local bool poolDestroyed = false;
+
+namespace {
+struct Pool {
+  vector<vector<unsigned char>> buffers;
+  size_t bytes = 0;
+
+  void remove(int index) {
+    bytes -= buffers[index].capacity();
+    bytesHeld -= buffers[index].capacity();
+    buffers.erase(buffers.begin() + index);
+  }
+
+  ~Pool() {
+    bytesHeld -= bytes;
+    poolDestroyed = true;
+  }
+};
+}
+
+static thread_local Pool pool;
+
+vector<unsigned char> BufferPool::acquire(size_t size) {
+  if (poolDestroyed) {
+    return vector<unsigned char>(size);
+  }
+
+  // the smallest buffer that fits leaves the big ones for big images
+  int best = -1;
+  for (int i = 0; i < pool.buffers.size(); i++) {
+    size_t capacity = pool.buffers[i].capacity();
+    if (capacity >= size && (best < 0 || capacity < pool.buffers[best].capacity())) {
+      best = i;
+    }
+  }
+
+  if (best >= 0) {
+    vector<unsigned char> buffer = std::move(pool.buffers[best]);
+    pool.bytes -= buffer.capacity();
+    bytesHeld -= buffer.capacity();
+    pool.buffers.erase(pool.buffers.begin() + best);
+    buffer.resize(size);
+    reuses++;
+    return buffer;
+  }
+
+  allocations++;
+  bytesAllocated += size;
+  Instrumentation::recordAllocation(size);
+  return vector<unsigned char>(size);
+}
+
+void BufferPool::recycle(vector<unsigned char>&& buffer) {
+  size_t capacity = buffer.capacity();
+  if (capacity == 0 || capacity > maxBytes || poolDestroyed) {
+    return;
+  }
+
+  pool.buffers.push_back(std::move(buffer));
+  pool.bytes += capacity;
+  bytesHeld += capacity;
+
+  while (pool.buffers.size() > maxBuffers || pool.bytes > maxBytes) {
+    int smallest = 0;
+    for (int i = 1; i < pool.buffers.size(); i++) {
+      if (pool.buffers[i].capacity() < pool.buffers[smallest].capacity()) {
+        smallest = i;
+      }
+    }
+    pool.remove(smallest);
+  }
+}
+
+void BufferPool::clear() {
+  if (poolDestroyed) {
+    return;
+  }
+  while (!pool.buffers.empty()) {
+    pool.remove(pool.buffers.size() - 1);
+  }
+}
+
+void BufferPool::setLimits(int buffers, size_t bytes) {
+  maxBuffers = buffers;
+  maxBytes = bytes;
+}
+
+BufferPool::Stats BufferPool::getStats() {
+  Stats stats;
+  stats.allocations = allocations;
+  stats.bytesAllocated = bytesAllocated;
+  stats.reuses = reuses;
+  stats.bytesHeld = bytesHeld;
+  return stats;
+}
+
+void BufferPool::resetStats() {
+  allocations = 0;
+  bytesAllocated = 0;
+  reuses = 0;
+}
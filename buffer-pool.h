@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+// per-thread free list of byte buffers for filters that need a full-size temporary image
+// a filter acquires its output buffer and recycles the pixels it replaces, so working through
+// images of the same size over and over stops allocating after the first one
+class BufferPool {
+public:
+  struct Stats {
+    // buffers that had to be allocated and the bytes they took
+    long long allocations = 0;
+    long long bytesAllocated = 0;
+    // buffers handed out again from a pool
+    long long reuses = 0;
+    // bytes sitting in pools right now
+    long long bytesHeld = 0;
+  };
+
+  // a buffer of size bytes, its contents are left over from earlier use
+  static std::vector<unsigned char> acquire(size_t size);
+  // hands a buffer back to this thread's pool, past the limits the smallest pooled buffer is freed
+  static void recycle(std::vector<unsigned char>&& buffer);
+  // frees this thread's pooled buffers
+  static void clear();
+
+  // limits for each thread's pool, defaults are 4 buffers and 1 GB
+  static void setLimits(int maxBuffers, size_t maxBytes);
+
+  // counters summed over every thread
+  static Stats getStats();
+  static void resetStats();
+};
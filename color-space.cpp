@@ -0,0 +1,188 @@
+#include "color-space.h"
+#include <algorithm>
+#include <cmath>
+
+// pixels are converted BLOCK at a time through fixed-size planar arrays, every loop over a block has
+// a known trip count and only selects, so the compiler can vectorize it
+// the selects only become blends with -fno-trapping-math, see the Makefile
+const int BLOCK = 8;
+using Block = float[3][BLOCK];
+
+// full range BT.601
+const float KR = 0.299f;
+const float KG = 0.587f;
+const float KB = 0.114f;
+const float CHROMA_OFFSET = 128;
+
+// deinterleaves up to BLOCK pixels, gray pixels repeat their sample, missing pixels are black
+static void loadBlock(const unsigned char* pixels, int count, int numChannels, float scale, Block& rgb) {
+  for (int channel = 0; channel < 3; channel++) {
+    int offset = numChannels == 3 ? channel : 0;
+    for (int i = 0; i < BLOCK; i++) {
+      rgb[channel][i] = i < count ? pixels[i * numChannels + offset] * scale : 0;
+    }
+  }
+}
+
+static void storeBlock(const Block& rgb, int count, int numChannels, float scale, int maxColor, unsigned char* pixels) {
+  unsigned char rounded[3][BLOCK];
+  for (int channel = 0; channel < 3; channel++) {
+    for (int i = 0; i < BLOCK; i++) {
+      rounded[channel][i] = std::clamp(rgb[channel][i] * scale + 0.5f, 0.0f, (float)maxColor);
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    if (numChannels == 1) {
+      pixels[i] = (rounded[0][i] + rounded[1][i] + rounded[2][i]) / 3;
+      continue;
+    }
+    pixels[i * 3] = rounded[0][i];
+    pixels[i * 3 + 1] = rounded[1][i];
+    pixels[i * 3 + 2] = rounded[2][i];
+  }
+}
+
+// rgb is 0-1, hsv picks value and the HSV saturation instead of lightness
+static void rgbToHue(const Block& rgb, Block& out, bool hsv) {
+  for (int i = 0; i < BLOCK; i++) {
+    float r = rgb[0][i];
+    float g = rgb[1][i];
+    float b = rgb[2][i];
+    float maximum = std::max(r, std::max(g, b));
+    float minimum = std::min(r, std::min(g, b));
+    float chroma = maximum - minimum;
+
+    // gray pixels have 0 on every numerator, so the clamped divisor only keeps them finite
+    float inverse = 1 / std::max(chroma, 1e-6f);
+    float redHue = (g - b) * inverse;
+    float greenHue = (b - r) * inverse + 2;
+    float blueHue = (r - g) * inverse + 4;
+    float hue = maximum == r ? redHue : maximum == g ? greenHue : blueHue;
+    hue = hue < 0 ? hue + 6 : hue;
+    hue = hue >= 6 ? hue - 6 : hue;
+    out[0][i] = hue * 60;
+
+    if (hsv) {
+      out[1][i] = chroma / std::max(maximum, 1e-6f);
+      out[2][i] = maximum;
+    }
+    else {
+      out[1][i] = chroma / std::max(1 - std::abs(maximum + minimum - 1), 1e-6f);
+      out[2][i] = (maximum + minimum) / 2;
+    }
+  }
+}
+
+static void hslToRGB(const Block& hsl, Block& rgb) {
+  // channel n is l - a * clamp(min(k - 3, 9 - k), -1, 1) with k = (n + hue / 30) mod 12
+  const float OFFSETS[3] = {0, 8, 4};
+  for (int channel = 0; channel < 3; channel++) {
+    for (int i = 0; i < BLOCK; i++) {
+      float lightness = hsl[2][i];
+      float a = hsl[1][i] * std::min(lightness, 1 - lightness);
+      float k = OFFSETS[channel] + hsl[0][i] / 30;
+      k = k >= 12 ? k - 12 : k;
+      rgb[channel][i] = lightness - a * std::clamp(std::min(k - 3, 9 - k), -1.0f, 1.0f);
+    }
+  }
+}
+
+static void hsvToRGB(const Block& hsv, Block& rgb) {
+  // channel n is v - v * s * clamp(min(k, 4 - k), 0, 1) with k = (n + hue / 60) mod 6
+  const float OFFSETS[3] = {5, 3, 1};
+  for (int channel = 0; channel < 3; channel++) {
+    for (int i = 0; i < BLOCK; i++) {
+      float value = hsv[2][i];
+      float k = OFFSETS[channel] + hsv[0][i] / 60;
+      k = k >= 6 ? k - 6 : k;
+      rgb[channel][i] = value - value * hsv[1][i] * std::clamp(std::min(k, 4 - k), 0.0f, 1.0f);
+    }
+  }
+}
+
+// rgb is 0-255
+static void rgbToYCbCr(const Block& rgb, Block& out) {
+  for (int i = 0; i < BLOCK; i++) {
+    float y = KR * rgb[0][i] + KG * rgb[1][i] + KB * rgb[2][i];
+    out[0][i] = y;
+    out[1][i] = CHROMA_OFFSET + (rgb[2][i] - y) / (2 * (1 - KB));
+    out[2][i] = CHROMA_OFFSET + (rgb[0][i] - y) / (2 * (1 - KR));
+  }
+}
+
+static void yCbCrToRGB(const Block& ycc, Block& rgb) {
+  for (int i = 0; i < BLOCK; i++) {
+    float y = ycc[0][i];
+    float cb = ycc[1][i] - CHROMA_OFFSET;
+    float cr = ycc[2][i] - CHROMA_OFFSET;
+    float r = y + 2 * (1 - KR) * cr;
+    float b = y + 2 * (1 - KB) * cb;
+    rgb[0][i] = r;
+    rgb[1][i] = (y - KR * r - KB * b) / KG;
+    rgb[2][i] = b;
+  }
+}
+
+ColorPlanes::ColorPlanes(ColorSpace space, int numPixels) : space(space), numPixels(numPixels) {
+  for (std::vector<float>& plane : planes) {
+    plane.resize(numPixels);
+  }
+}
+
+void ColorPlanes::fromPixels(const unsigned char* pixels, int first, int count, int numChannels, int maxColor/*=255*/) {
+  float* const offsetPlanes[3] = {planes[0].data() + first, planes[1].data() + first, planes[2].data() + first};
+  convertFromPixels(space, pixels + (size_t)first * numChannels, count, numChannels, maxColor, offsetPlanes);
+}
+
+void ColorPlanes::toPixels(unsigned char* pixels, int first, int count, int numChannels, int maxColor/*=255*/) const {
+  const float* const offsetPlanes[3] = {planes[0].data() + first, planes[1].data() + first, planes[2].data() + first};
+  convertToPixels(space, offsetPlanes, pixels + (size_t)first * numChannels, count, numChannels, maxColor);
+}
+
+void ColorPlanes::convertFromPixels(ColorSpace space, const unsigned char* pixels, int count, int numChannels, int maxColor, float* const planes[3]) {
+  // HSL and HSV work on 0-1, YCbCr on 0-255
+  float scale = space == ColorSpace::YCBCR ? 255.0f / maxColor : 1.0f / maxColor;
+
+  for (int begin = 0; begin < count; begin += BLOCK) {
+    int blockCount = std::min(BLOCK, count - begin);
+    Block rgb;
+    Block out;
+    loadBlock(pixels + (size_t)begin * numChannels, blockCount, numChannels, scale, rgb);
+
+    if (space == ColorSpace::YCBCR) {
+      rgbToYCbCr(rgb, out);
+    }
+    else {
+      rgbToHue(rgb, out, space == ColorSpace::HSV);
+    }
+
+    for (int channel = 0; channel < 3; channel++) {
+      std::copy(out[channel], out[channel] + blockCount, planes[channel] + begin);
+    }
+  }
+}
+
+void ColorPlanes::convertToPixels(ColorSpace space, const float* const planes[3], unsigned char* pixels, int count, int numChannels, int maxColor) {
+  float scale = space == ColorSpace::YCBCR ? maxColor / 255.0f : maxColor;
+
+  for (int begin = 0; begin < count; begin += BLOCK) {
+    int blockCount = std::min(BLOCK, count - begin);
+    Block in = {};
+    Block rgb;
+    for (int channel = 0; channel < 3; channel++) {
+      std::copy(planes[channel] + begin, planes[channel] + begin + blockCount, in[channel]);
+    }
+
+    if (space == ColorSpace::HSL) {
+      hslToRGB(in, rgb);
+    }
+    else if (space == ColorSpace::HSV) {
+      hsvToRGB(in, rgb);
+    }
+    else {
+      yCbCrToRGB(in, rgb);
+    }
+    storeBlock(rgb, blockCount, numChannels, scale, maxColor, pixels + (size_t)begin * numChannels);
+  }
+}
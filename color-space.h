@@ -0,0 +1,29 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+enum class ColorSpace { HSL, HSV, YCBCR };
+
+// an image or span of pixels split into one float plane per channel
+// HSL and HSV: hue in degrees 0 up to 360, saturation and lightness or value 0-1
+// YCBCR: full range BT.601 like JPEG, y, cb and cr are 0-255 with cb and cr centered on 128
+struct ColorPlanes {
+  ColorSpace space = ColorSpace::HSL;
+  int numPixels = 0;
+  // hue, saturation, lightness or value, or y, cb, cr
+  std::array<std::vector<float>, 3> planes;
+
+  ColorPlanes() = default;
+  ColorPlanes(ColorSpace space, int numPixels);
+
+  // converts pixels [first, first + count) of interleaved 8-bit samples into the same range of the planes
+  // single channel pixels are treated as gray rgb
+  void fromPixels(const unsigned char* pixels, int first, int count, int numChannels, int maxColor=255);
+  // single channel pixels get the mean of r, g and b
+  void toPixels(unsigned char* pixels, int first, int count, int numChannels, int maxColor=255) const;
+
+  // the span converters behind fromPixels and toPixels, planes[k] holds channel k of each pixel
+  static void convertFromPixels(ColorSpace space, const unsigned char* pixels, int count, int numChannels, int maxColor, float* const planes[3]);
+  static void convertToPixels(ColorSpace space, const float* const planes[3], unsigned char* pixels, int count, int numChannels, int maxColor);
+};
@@ -0,0 +1,294 @@
+#include "convolution-kernel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <numeric>
+
+using std::vector;
+
+ConvolutionKernel::ConvolutionKernel(int width, int height, vector<double> weights, double divisor/*=1*/, double bias/*=0*/) {
+  this->width = std::max(width, 1) | 1;
+  this->height = std::max(height, 1) | 1;
+  this->weights.assign(this->width * this->height, 0);
+  this->bias = bias;
+
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      if (row * width + col < weights.size()) {
+        this->weights[row * this->width + col] = weights[row * width + col] / (divisor != 0 ? divisor : 1);
+      }
+    }
+  }
+}
+
+// factories
+
+ConvolutionKernel ConvolutionKernel::sobelX() {
+  return ConvolutionKernel(3, 3, {-1, 0, 1,
+                                  -2, 0, 2,
+                                  -1, 0, 1});
+}
+
+ConvolutionKernel ConvolutionKernel::sobelY() {
+  return ConvolutionKernel(3, 3, {-1, -2, -1,
+                                   0,  0,  0,
+                                   1,  2,  1});
+}
+
+ConvolutionKernel ConvolutionKernel::laplacian() {
+  return ConvolutionKernel(3, 3, {0,  1, 0,
+                                  1, -4, 1,
+                                  0,  1, 0});
+}
+
+ConvolutionKernel ConvolutionKernel::emboss() {
+  return ConvolutionKernel(3, 3, {-2, -1, 0,
+                                  -1,  1, 1,
+                                   0,  1, 2});
+}
+
+ConvolutionKernel ConvolutionKernel::sharpen() {
+  return ConvolutionKernel(3, 3, { 0, -1,  0,
+                                  -1,  5, -1,
+                                   0, -1,  0});
+}
+
+ConvolutionKernel ConvolutionKernel::box(int radius) {
+  int size = 2 * std::max(radius, 0) + 1;
+  return ConvolutionKernel(size, size, vector<double>(size * size, 1), size * size);
+}
+
+ConvolutionKernel ConvolutionKernel::gaussian(int radius) {
+  radius = std::max(radius, 0);
+  int size = 2 * radius + 1;
+  double sd = 0.3 * (radius - 1) + 0.8;
+
+  vector<double> weights(size * size);
+  for (int row = 0; row < size; row++) {
+    for (int col = 0; col < size; col++) {
+      int y = row - radius;
+      int x = col - radius;
+      weights[row * size + col] = std::exp(-(x * x + y * y) / (2 * sd * sd));
+    }
+  }
+  return ConvolutionKernel(size, size, weights, std::accumulate(weights.begin(), weights.end(), 0.0));
+}
+
+ConvolutionKernel ConvolutionKernel::disk(int radius) {
+  radius = std::max(radius, 0);
+  int size = 2 * radius + 1;
+
+  vector<double> weights(size * size);
+  for (int row = 0; row < size; row++) {
+    for (int col = 0; col < size; col++) {
+      int y = row - radius;
+      int x = col - radius;
+      weights[row * size + col] = x * x + y * y <= radius * radius + radius ? 1 : 0;
+    }
+  }
+  return ConvolutionKernel(size, size, weights, std::accumulate(weights.begin(), weights.end(), 0.0));
+}
+
+bool ConvolutionKernel::named(const std::string& name, ConvolutionKernel& kernel, int radius/*=1*/) {
+  if (name == "sobelX") {
+    kernel = sobelX();
+  }
+  else if (name == "sobelY") {
+    kernel = sobelY();
+  }
+  else if (name == "laplacian") {
+    kernel = laplacian();
+  }
+  else if (name == "emboss") {
+    kernel = emboss();
+  }
+  else if (name == "sharpen") {
+    kernel = sharpen();
+  }
+  else if (name == "box") {
+    kernel = box(radius);
+  }
+  else if (name == "gaussian") {
+    kernel = gaussian(radius);
+  }
+  else if (name == "disk") {
+    kernel = disk(radius);
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+int ConvolutionKernel::getWidth() const {
+  return width;
+}
+
+int ConvolutionKernel::getHeight() const {
+  return height;
+}
+
+double ConvolutionKernel::getBias() const {
+  return bias;
+}
+
+double ConvolutionKernel::at(int row, int col) const {
+  return weights[row * width + col];
+}
+
+const vector<double>& ConvolutionKernel::getWeights() const {
+  return weights;
+}
+
+bool ConvolutionKernel::separate(vector<double>& column, vector<double>& row) const {
+  // the largest weight's row and column give the factors, every other weight has to be their product
+  int pivot = 0;
+  for (int i = 1; i < weights.size(); i++) {
+    if (std::abs(weights[i]) > std::abs(weights[pivot])) {
+      pivot = i;
+    }
+  }
+  double largest = weights[pivot];
+  if (largest == 0) {
+    return false;
+  }
+
+  int pivotRow = pivot / width;
+  int pivotCol = pivot % width;
+  column.resize(height);
+  row.resize(width);
+  for (int y = 0; y < height; y++) {
+    column[y] = at(y, pivotCol);
+  }
+  for (int x = 0; x < width; x++) {
+    row[x] = at(pivotRow, x) / largest;
+  }
+
+  const double TOLERANCE = 1e-9 * std::abs(largest);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      if (std::abs(at(y, x) - column[y] * row[x]) > TOLERANCE) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+FixedPointWeights FixedPointWeights::quantize(const vector<double>& weights, int maxSample) {
+  double largest = 0;
+  double absoluteSum = 0;
+  for (double weight : weights) {
+    largest = std::max(largest, std::abs(weight));
+    absoluteSum += std::abs(weight);
+  }
+
+  FixedPointWeights fixed;
+  fixed.shift = MAX_SHIFT;
+  // a little headroom for the rounding of each weight
+  while (fixed.shift > 0 && (largest * (1 << fixed.shift) > INT16_MAX - 1 ||
+                             (absoluteSum * (1 << fixed.shift) + weights.size()) * maxSample > INT32_MAX)) {
+    fixed.shift--;
+  }
+
+  // weights are rounded down, then the ones that lost the most get 1 back until the integers add up to the
+  // rounded total, so no weight is ever more than 1 away from its exact value
+  double scale = 1 << fixed.shift;
+  long long total = 0;
+  double exactTotal = 0;
+  vector<double> remainders(weights.size());
+  fixed.weights.resize(weights.size());
+  for (int i = 0; i < weights.size(); i++) {
+    double scaled = weights[i] * scale;
+    fixed.weights[i] = (int16_t)std::floor(scaled);
+    remainders[i] = scaled - std::floor(scaled);
+    total += fixed.weights[i];
+    exactTotal += scaled;
+  }
+
+  // equal remainders, as in flat kernels, are taken in golden-ratio order so the rounded-up weights are spread
+  // across the kernel, a border that cuts off part of it then still sees errors of both signs
+  auto spread = [](int i) { return std::fmod(i * 0.6180339887498949, 1.0); };
+  long long residue = std::llround(exactTotal) - total;
+  vector<int> order(weights.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    return remainders[a] != remainders[b] ? remainders[a] > remainders[b] : spread(a) < spread(b);
+  });
+  for (int i = 0; i < residue && i < order.size(); i++) {
+    fixed.weights[order[i]]++;
+  }
+  return fixed;
+}
+
+long long FixedPointWeights::bound(int maxSample) const {
+  long long sum = 0;
+  for (int16_t weight : weights) {
+    sum += std::abs(weight);
+  }
+  return sum * maxSample;
+}
+
+// rough costs in nanoseconds, fitted to timings of disk kernels on one core
+// a weight is one 16-bit multiply-add per output sample, the fft terms are per sample of a tile and
+// per tile
+const double WEIGHT_COST = 0.2;
+const double PASS_COST = 0.8;
+const double FFT_COST = 1.6;
+const double TILE_SAMPLE_COST = 1;
+const double TILE_COST = 50000;
+
+ConvolutionPlan ConvolutionPlan::choose(const ConvolutionKernel& kernel, int imageWidth, int imageHeight, const std::string& method/*="auto"*/) {
+  int kernelWidth = kernel.getWidth();
+  int kernelHeight = kernel.getHeight();
+
+  ConvolutionPlan plan;
+  vector<double> column, row;
+  if (kernel.separate(column, row)) {
+    plan.method = SEPARABLE;
+    plan.cost = (kernelWidth + kernelHeight) * WEIGHT_COST + 2 * PASS_COST;
+  }
+  else {
+    plan.method = DIRECT;
+    plan.cost = kernelWidth * kernelHeight * WEIGHT_COST + PASS_COST;
+  }
+  if (method == "direct") {
+    return plan;
+  }
+
+  // every power-of-two tile that fits the kernel, no bigger than the whole image needs
+  auto candidates = [](int kernelSize, int imageSize) {
+    vector<int> sizes;
+    for (int size = 2; size <= MAX_TILE; size *= 2) {
+      if (size >= kernelSize) {
+        sizes.push_back(size);
+      }
+      if (size >= imageSize + kernelSize - 1) {
+        break;
+      }
+    }
+    return sizes;
+  };
+
+  ConvolutionPlan best;
+  for (int tileWidth : candidates(kernelWidth, imageWidth)) {
+    for (int tileHeight : candidates(kernelHeight, imageHeight)) {
+      int outputWidth = tileWidth - kernelWidth + 1;
+      int outputHeight = tileHeight - kernelHeight + 1;
+      double tiles = std::ceil((double)imageWidth / outputWidth) * std::ceil((double)imageHeight / outputHeight);
+      double tileCost = (double)tileWidth * tileHeight * (std::log2((double)tileWidth * tileHeight) * FFT_COST + TILE_SAMPLE_COST) + TILE_COST;
+      double cost = tiles * tileCost / ((double)imageWidth * imageHeight);
+      if (best.tileWidth == 0 || cost < best.cost) {
+        best.method = FFT;
+        best.tileWidth = tileWidth;
+        best.tileHeight = tileHeight;
+        best.cost = cost;
+      }
+    }
+  }
+  // kernels bigger than the largest tile can only run directly
+  if (best.tileWidth == 0 || (method != "fft" && best.cost >= plan.cost)) {
+    return plan;
+  }
+  return best;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// weights of a 2-D convolution, output = sum of weight * sample / divisor + bias
+// widths and heights are odd so the kernel is centered on the output pixel
+// kernels that sum to 0 (edges, laplacian) give signed results, a bias of 128 keeps the negative half
+class ConvolutionKernel {
+private:
+  int width = 1;
+  int height = 1;
+  // row-major, divisor already applied
+  std::vector<double> weights = {1};
+  double bias = 0;
+
+public:
+  // identity
+  ConvolutionKernel() = default;
+  // weights are width * height row-major values, even sizes are padded with zeros on the right and bottom
+  ConvolutionKernel(int width, int height, std::vector<double> weights, double divisor=1, double bias=0);
+
+  static ConvolutionKernel sobelX();
+  static ConvolutionKernel sobelY();
+  static ConvolutionKernel laplacian();
+  static ConvolutionKernel emboss();
+  static ConvolutionKernel sharpen();
+  static ConvolutionKernel box(int radius);
+  // same standard deviation as PNM's gaussian blur for the radius
+  static ConvolutionKernel gaussian(int radius);
+  // flat circle, a lens-like blur that isn't separable
+  static ConvolutionKernel disk(int radius);
+  // any of the factories above by name, radius is for box, gaussian and disk
+  // returns false and leaves kernel alone for unknown names
+  static bool named(const std::string& name, ConvolutionKernel& kernel, int radius=1);
+
+  int getWidth() const;
+  int getHeight() const;
+  double getBias() const;
+  double at(int row, int col) const;
+  const std::vector<double>& getWeights() const;
+
+  // true if the kernel is rank 1, then at(row, col) == column[row] * this->row[col] and the kernel can run
+  // as a vertical and a horizontal 1-D pass
+  bool separate(std::vector<double>& column, std::vector<double>& row) const;
+};
+
+// weights rounded to 16-bit integers with shift fraction bits, shift is as large as it can be while every
+// weight fits and a sum of weight * sample for samples up to maxSample fits 32 bits
+// weights are rounded up or down so the integers add up to the rounded total, each within 1 of its exact value
+struct FixedPointWeights {
+  static const int MAX_SHIFT = 14;
+
+  int shift = 0;
+  std::vector<int16_t> weights;
+
+  static FixedPointWeights quantize(const std::vector<double>& weights, int maxSample);
+  // largest possible |sum of weight * sample|
+  long long bound(int maxSample) const;
+};
+
+// how PNM::convolve runs a kernel on an image, whichever has the lowest estimated cost per output sample
+// direct sums every weight, separable sums a column and a row, fft multiplies spectra of tiles
+struct ConvolutionPlan {
+  enum Method { DIRECT, SEPARABLE, FFT };
+  // tiles are at most this size, which bounds the memory each thread needs
+  static const int MAX_TILE = 512;
+
+  Method method = DIRECT;
+  // fft tile size, each tile gives (tileWidth - kernel width + 1) * (tileHeight - kernel height + 1) outputs
+  int tileWidth = 0;
+  int tileHeight = 0;
+  // estimated nanoseconds per output sample
+  double cost = 0;
+
+  // method: "auto", "direct" (separable when the kernel is), "fft"
+  static ConvolutionPlan choose(const ConvolutionKernel& kernel, int imageWidth, int imageHeight, const std::string& method="auto");
+};
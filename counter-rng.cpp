@@ -0,0 +1,112 @@
+#include "counter-rng.h"
+#include <array>
+#include <cmath>
+
+// a block is LANES philox counters side by side, each gives 4 values
+const int LANES = CounterRNG::BLOCK / 4;
+const int ROUNDS = 10;
+const uint32_t MULTIPLIER_0 = 0xD2511F53;
+const uint32_t MULTIPLIER_1 = 0xCD9E8D57;
+const uint32_t KEY_STEP_0 = 0x9E3779B9;
+const uint32_t KEY_STEP_1 = 0xBB67AE85;
+
+// inverse normal CDF sampled at TABLE_SIZE + 1 evenly spaced probabilities, the top bits of a value
+// pick the interval and the rest interpolate inside it
+const int TABLE_BITS = 12;
+const int TABLE_SIZE = 1 << TABLE_BITS;
+const int FRACTION_BITS = 32 - TABLE_BITS;
+
+static double normalCDF(double x) {
+  return 0.5 * std::erfc(-x / std::sqrt(2.0));
+}
+
+// newton's method from 0, the CDF is concave on the root's side so it never overshoots
+static double inverseNormalCDF(double p) {
+  const double INV_SQRT_2PI = 0.3989422804014327;
+  double x = 0;
+  for (int i = 0; i < 100; i++) {
+    double step = (normalCDF(x) - p) / (INV_SQRT_2PI * std::exp(-x * x / 2));
+    x -= step;
+    if (std::abs(step) < 1e-12) {
+      break;
+    }
+  }
+  return x;
+}
+
+static const std::array<float, TABLE_SIZE + 1>& normalTable() {
+  static const std::array<float, TABLE_SIZE + 1> table = [] {
+    std::array<float, TABLE_SIZE + 1> quantiles;
+    for (int i = 0; i <= TABLE_SIZE; i++) {
+      quantiles[i] = inverseNormalCDF((i + 0.5) / (TABLE_SIZE + 1));
+    }
+    return quantiles;
+  }();
+  return table;
+}
+
+CounterRNG::CounterRNG(uint64_t seed, uint64_t stream/*=0*/) {
+  key[0] = seed;
+  key[1] = seed >> 32;
+  this->stream[0] = stream;
+  this->stream[1] = stream >> 32;
+}
+
+void CounterRNG::bits(uint32_t block, uint32_t (&out)[BLOCK]) const {
+  // counter words are (lane, block, stream), lanes are the only thing that differs across the arrays
+  uint32_t x0[LANES];
+  uint32_t x1[LANES];
+  uint32_t x2[LANES];
+  uint32_t x3[LANES];
+  for (int i = 0; i < LANES; i++) {
+    x0[i] = i;
+    x1[i] = block;
+    x2[i] = stream[0];
+    x3[i] = stream[1];
+  }
+
+  uint32_t k0 = key[0];
+  uint32_t k1 = key[1];
+  for (int round = 0; round < ROUNDS; round++) {
+    for (int i = 0; i < LANES; i++) {
+      uint64_t product0 = (uint64_t)MULTIPLIER_0 * x0[i];
+      uint64_t product1 = (uint64_t)MULTIPLIER_1 * x2[i];
+      uint32_t y0 = (uint32_t)(product1 >> 32) ^ x1[i] ^ k0;
+      uint32_t y2 = (uint32_t)(product0 >> 32) ^ x3[i] ^ k1;
+      x1[i] = product1;
+      x3[i] = product0;
+      x0[i] = y0;
+      x2[i] = y2;
+    }
+    k0 += KEY_STEP_0;
+    k1 += KEY_STEP_1;
+  }
+
+  for (int i = 0; i < LANES; i++) {
+    out[i] = x0[i];
+    out[LANES + i] = x1[i];
+    out[2 * LANES + i] = x2[i];
+    out[3 * LANES + i] = x3[i];
+  }
+}
+
+void CounterRNG::uniform(uint32_t block, float (&out)[BLOCK]) const {
+  uint32_t values[BLOCK];
+  bits(block, values);
+  for (int i = 0; i < BLOCK; i++) {
+    out[i] = (int32_t)values[i] * (1.0f / 2147483648.0f);
+  }
+}
+
+void CounterRNG::normal(uint32_t block, float (&out)[BLOCK]) const {
+  const std::array<float, TABLE_SIZE + 1>& table = normalTable();
+  const float FRACTION_SCALE = 1.0f / (1 << FRACTION_BITS);
+
+  uint32_t values[BLOCK];
+  bits(block, values);
+  for (int i = 0; i < BLOCK; i++) {
+    uint32_t index = values[i] >> FRACTION_BITS;
+    float fraction = (values[i] & ((1 << FRACTION_BITS) - 1)) * FRACTION_SCALE;
+    out[i] = table[index] + (table[index + 1] - table[index]) * fraction;
+  }
+}
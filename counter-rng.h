@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+// counter-based random numbers (philox 4x32-10), block i of a stream is a function of (seed, stream, i)
+// rather than the next state of a generator, so rows or tiles draw their own numbers in any order on
+// any thread and the result only depends on the seed
+// blocks are a fixed size so the loops over them vectorize
+class CounterRNG {
+private:
+  uint32_t key[2];
+  uint32_t stream[2];
+
+public:
+  static const int BLOCK = 64;
+
+  CounterRNG(uint64_t seed, uint64_t stream=0);
+
+  // values [block * BLOCK, (block + 1) * BLOCK) of the stream, up to 2^32 blocks
+  void bits(uint32_t block, uint32_t (&out)[BLOCK]) const;
+  // uniform in [-1, 1)
+  void uniform(uint32_t block, float (&out)[BLOCK]) const;
+  // mean 0 and standard deviation 1, read from an inverse CDF table
+  // tails are cut off at about 3.7 standard deviations, fewer than 0.03% of draws would land past that
+  void normal(uint32_t block, float (&out)[BLOCK]) const;
+};
@@ -3,7 +3,7 @@
 using std::vector;
 using std::string;
 
-void symExample(PNM img, const string outputPath) {
+void symExample(const PNM& img, const string outputPath) {
   vector<PNM> images;
   
   images = img.combinedReflection();
@@ -27,9 +27,11 @@ int main() {
   symExample(ice, outputPath);
 
   beach.grayscale();
-  beach.noise("salt", 0.05);
-  beach.noise("pepper", 0.05);
+  beach.noise("salt", 0.05, 1);
+  beach.noise("pepper", 0.05, 2);
   beach.write(outputPath + "noisyBeach");
+  beach.blur("median", 1);
+  beach.write(outputPath + "denoisedBeach");
 
   snow.chromaShift(200, -100, 300, 70);
   snow.write(outputPath + "shiftedSnow.ppm");
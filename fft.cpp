@@ -0,0 +1,180 @@
+#include "fft.h"
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+using std::complex;
+using std::vector;
+
+// transforms run LANES at a time side by side, real and imaginary parts in separate arrays, so every
+// butterfly is a fixed-length loop across the lanes that vectorizes
+const int LANES = 8;
+
+static vector<complex<float>> twiddles(int n) {
+  vector<complex<float>> factors(std::max(n / 2, 1));
+  for (int k = 0; k < n / 2; k++) {
+    double angle = -2 * std::numbers::pi * k / n;
+    factors[k] = {(float)std::cos(angle), (float)std::sin(angle)};
+  }
+  return factors;
+}
+
+// element i of lane l is at [i * LANES + l]
+static void transformLanes(float* re, float* im, int n, const vector<complex<float>>& factors, bool inverse) {
+  for (int i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      std::swap_ranges(re + i * LANES, re + (i + 1) * LANES, re + j * LANES);
+      std::swap_ranges(im + i * LANES, im + (i + 1) * LANES, im + j * LANES);
+    }
+  }
+
+  for (int length = 2; length <= n; length <<= 1) {
+    int half = length / 2;
+    int step = n / length;
+    for (int start = 0; start < n; start += length) {
+      for (int k = 0; k < half; k++) {
+        float wRe = factors[k * step].real();
+        float wIm = inverse ? -factors[k * step].imag() : factors[k * step].imag();
+        float* uRe = re + (start + k) * LANES;
+        float* uIm = im + (start + k) * LANES;
+        float* vRe = re + (start + k + half) * LANES;
+        float* vIm = im + (start + k + half) * LANES;
+        for (int l = 0; l < LANES; l++) {
+          float productRe = vRe[l] * wRe - vIm[l] * wIm;
+          float productIm = vRe[l] * wIm + vIm[l] * wRe;
+          vRe[l] = uRe[l] - productRe;
+          vIm[l] = uIm[l] - productIm;
+          uRe[l] += productRe;
+          uIm[l] += productIm;
+        }
+      }
+    }
+  }
+}
+
+FFT2D::FFT2D(int width, int height) {
+  this->width = width;
+  this->height = height;
+  rowTwiddles = twiddles(width);
+  columnTwiddles = twiddles(height);
+}
+
+int FFT2D::getWidth() const {
+  return width;
+}
+
+int FFT2D::getHeight() const {
+  return height;
+}
+
+int FFT2D::getSpectrumWidth() const {
+  return width / 2 + 1;
+}
+
+void FFT2D::transformColumns(complex<float>* spectrum, bool inverse) const {
+  int spectrumWidth = getSpectrumWidth();
+  vector<float> re(height * LANES, 0);
+  vector<float> im(height * LANES, 0);
+  for (int first = 0; first < spectrumWidth; first += LANES) {
+    int count = std::min(LANES, spectrumWidth - first);
+    for (int row = 0; row < height; row++) {
+      for (int l = 0; l < count; l++) {
+        re[row * LANES + l] = spectrum[row * spectrumWidth + first + l].real();
+        im[row * LANES + l] = spectrum[row * spectrumWidth + first + l].imag();
+      }
+    }
+    transformLanes(re.data(), im.data(), height, columnTwiddles, inverse);
+    for (int row = 0; row < height; row++) {
+      for (int l = 0; l < count; l++) {
+        spectrum[row * spectrumWidth + first + l] = {re[row * LANES + l], im[row * LANES + l]};
+      }
+    }
+  }
+}
+
+// rows go through the complex transform two at a time, one as the real part and one as the imaginary
+// part, and are separated afterwards using the symmetry of real rows' spectra
+void FFT2D::forward(const float* real, complex<float>* spectrum) const {
+  int spectrumWidth = getSpectrumWidth();
+  int numPairs = (height + 1) / 2;
+  vector<float> re(width * LANES);
+  vector<float> im(width * LANES);
+
+  for (int firstPair = 0; firstPair < numPairs; firstPair += LANES) {
+    std::fill(re.begin(), re.end(), 0);
+    std::fill(im.begin(), im.end(), 0);
+    for (int l = 0; l < LANES && firstPair + l < numPairs; l++) {
+      int row = 2 * (firstPair + l);
+      for (int i = 0; i < width; i++) {
+        re[i * LANES + l] = real[row * width + i];
+        im[i * LANES + l] = row + 1 < height ? real[(row + 1) * width + i] : 0;
+      }
+    }
+    transformLanes(re.data(), im.data(), width, rowTwiddles, false);
+
+    for (int l = 0; l < LANES && firstPair + l < numPairs; l++) {
+      int row = 2 * (firstPair + l);
+      for (int k = 0; k < spectrumWidth; k++) {
+        int mirrored = (width - k) % width;
+        float zRe = re[k * LANES + l];
+        float zIm = im[k * LANES + l];
+        float mRe = re[mirrored * LANES + l];
+        float mIm = im[mirrored * LANES + l];
+        // a = (z[k] + conj(z[-k])) / 2, b = (z[k] - conj(z[-k])) / 2i
+        spectrum[row * spectrumWidth + k] = {(zRe + mRe) / 2, (zIm - mIm) / 2};
+        if (row + 1 < height) {
+          spectrum[(row + 1) * spectrumWidth + k] = {(zIm + mIm) / 2, (mRe - zRe) / 2};
+        }
+      }
+    }
+  }
+
+  transformColumns(spectrum, false);
+}
+
+void FFT2D::inverse(complex<float>* spectrum, float* real) const {
+  transformColumns(spectrum, true);
+
+  int spectrumWidth = getSpectrumWidth();
+  int numPairs = (height + 1) / 2;
+  float scale = 1.0f / ((float)width * height);
+  vector<float> re(width * LANES);
+  vector<float> im(width * LANES);
+
+  for (int firstPair = 0; firstPair < numPairs; firstPair += LANES) {
+    std::fill(re.begin(), re.end(), 0);
+    std::fill(im.begin(), im.end(), 0);
+    // z = a + ib over the whole row, the missing half of each spectrum is the conjugate of the kept half
+    for (int l = 0; l < LANES && firstPair + l < numPairs; l++) {
+      int row = 2 * (firstPair + l);
+      for (int k = 0; k < width; k++) {
+        bool kept = k < spectrumWidth;
+        int index = kept ? k : width - k;
+        complex<float> a = spectrum[row * spectrumWidth + index];
+        complex<float> b = row + 1 < height ? spectrum[(row + 1) * spectrumWidth + index] : complex<float>();
+        if (!kept) {
+          a = std::conj(a);
+          b = std::conj(b);
+        }
+        re[k * LANES + l] = a.real() - b.imag();
+        im[k * LANES + l] = a.imag() + b.real();
+      }
+    }
+    transformLanes(re.data(), im.data(), width, rowTwiddles, true);
+
+    for (int l = 0; l < LANES && firstPair + l < numPairs; l++) {
+      int row = 2 * (firstPair + l);
+      for (int i = 0; i < width; i++) {
+        real[row * width + i] = re[i * LANES + l] * scale;
+        if (row + 1 < height) {
+          real[(row + 1) * width + i] = im[i * LANES + l] * scale;
+        }
+      }
+    }
+  }
+}
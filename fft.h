@@ -0,0 +1,33 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+// 2-D discrete fourier transforms of real images of one power-of-two size, the twiddle factors are
+// computed once and shared by every transform
+// a real image's spectrum is symmetric, so only columns 0 to width / 2 of it are kept
+class FFT2D {
+private:
+  int width;
+  int height;
+  // e^(-2 pi i k / n) for k < n / 2, for the row and column sizes
+  std::vector<std::complex<float>> rowTwiddles;
+  std::vector<std::complex<float>> columnTwiddles;
+
+  // runs the column transforms over the kept half of the spectrum, a few columns at a time
+  void transformColumns(std::complex<float>* spectrum, bool inverse) const;
+
+public:
+  // sizes have to be powers of two
+  FFT2D(int width, int height);
+
+  int getWidth() const;
+  int getHeight() const;
+  // width / 2 + 1
+  int getSpectrumWidth() const;
+
+  // real is width * height row-major, spectrum gets height rows of getSpectrumWidth() values
+  void forward(const float* real, std::complex<float>* spectrum) const;
+  // the spectrum is overwritten, the result is scaled so inverse(forward(x)) == x
+  void inverse(std::complex<float>* spectrum, float* real) const;
+};
@@ -0,0 +1,238 @@
+#include "histogram.h"
+#include "simd-kernels.h"
+#include "color-space.h"
+#include <algorithm>
+#include <cstdint>
+
+using Bins = Histogram::Bins;
+
+// pixels are counted CHUNK at a time through buffers on the stack
+const int CHUNK = 1024;
+// every value has COPIES counters used in turn, so a run of the same value doesn't make each
+// increment wait for the one before it
+const int COPIES = 4;
+using Counts = uint32_t[COPIES][Histogram::BINS];
+
+static void countValues(const unsigned char* values, int count, int stride, Counts& counts) {
+  int i = 0;
+  for (; i + COPIES <= count; i += COPIES) {
+    for (int copy = 0; copy < COPIES; copy++) {
+      counts[copy][values[(i + copy) * stride]]++;
+    }
+  }
+  for (; i < count; i++) {
+    counts[0][values[i * stride]]++;
+  }
+}
+
+static void addCounts(const Counts& counts, Bins& bins) {
+  for (int value = 0; value < Histogram::BINS; value++) {
+    for (int copy = 0; copy < COPIES; copy++) {
+      bins[value] += counts[copy][value];
+    }
+  }
+}
+
+static int toBin(float fraction) {
+  return std::clamp((int)(fraction * 255 + 0.5f), 0, Histogram::BINS - 1);
+}
+
+void Histogram::accumulate(const unsigned char* pixels, int numPixels, int numChannels, bool withHSL/*=false*/) {
+  this->numPixels += numPixels;
+
+  Counts luma = {};
+  if (numChannels == 1) {
+    countValues(pixels, numPixels, 1, luma);
+    for (Bins& channel : channels) {
+      addCounts(luma, channel);
+    }
+  }
+  else {
+    Counts rgb[3] = {};
+    unsigned char gray[CHUNK];
+    for (int begin = 0; begin < numPixels; begin += CHUNK) {
+      int count = std::min(CHUNK, numPixels - begin);
+      const unsigned char* chunk = pixels + (size_t)begin * 3;
+      for (int channel = 0; channel < 3; channel++) {
+        countValues(chunk + channel, count, 3, rgb[channel]);
+      }
+      SimdKernels::get().grayscale(chunk, gray, count, 709);
+      countValues(gray, count, 1, luma);
+    }
+    for (int channel = 0; channel < 3; channel++) {
+      addCounts(rgb[channel], channels[channel]);
+    }
+  }
+  addCounts(luma, luminance);
+
+  if (!withHSL) {
+    return;
+  }
+  hasHSL = true;
+  float hsl[3][CHUNK];
+  float* const planes[3] = {hsl[0], hsl[1], hsl[2]};
+  for (int begin = 0; begin < numPixels; begin += CHUNK) {
+    int count = std::min(CHUNK, numPixels - begin);
+    ColorPlanes::convertFromPixels(ColorSpace::HSL, pixels + (size_t)begin * numChannels, count, numChannels, 255, planes);
+    for (int i = 0; i < count; i++) {
+      hue[std::clamp((int)hsl[0][i], 0, HUE_BINS - 1)]++;
+      saturation[toBin(hsl[1][i])]++;
+      lightness[toBin(hsl[2][i])]++;
+    }
+  }
+}
+
+void Histogram::add(const Histogram& other) {
+  numPixels += other.numPixels;
+  hasHSL = hasHSL || other.hasHSL;
+  for (int value = 0; value < BINS; value++) {
+    for (int channel = 0; channel < 3; channel++) {
+      channels[channel][value] += other.channels[channel][value];
+    }
+    luminance[value] += other.luminance[value];
+    saturation[value] += other.saturation[value];
+    lightness[value] += other.lightness[value];
+  }
+  for (int degree = 0; degree < HUE_BINS; degree++) {
+    hue[degree] += other.hue[degree];
+  }
+}
+
+int Histogram::otsuThreshold(const Bins& bins) {
+  long long total = 0;
+  double sum = 0;
+  for (int value = 0; value < BINS; value++) {
+    total += bins[value];
+    sum += (double)value * bins[value];
+  }
+
+  // splitting after each value in turn, the between-class variance is countBelow * countAbove * (meanBelow - meanAbove)^2
+  long long countBelow = 0;
+  double sumBelow = 0;
+  double bestVariance = -1;
+  int threshold = 0;
+  for (int value = 0; value < BINS; value++) {
+    countBelow += bins[value];
+    sumBelow += (double)value * bins[value];
+    long long countAbove = total - countBelow;
+    if (countBelow == 0 || countAbove == 0) {
+      continue;
+    }
+
+    double meanDifference = sumBelow / countBelow - (sum - sumBelow) / countAbove;
+    double variance = (double)countBelow * countAbove * meanDifference * meanDifference;
+    if (variance > bestVariance) {
+      bestVariance = variance;
+      threshold = value;
+    }
+  }
+  return threshold;
+}
+
+int Histogram::triangleThreshold(const Bins& bins) {
+  int first = 0;
+  while (first < BINS - 1 && bins[first] == 0) {
+    first++;
+  }
+  int last = BINS - 1;
+  while (last > 0 && bins[last] == 0) {
+    last--;
+  }
+  if (first >= last) {
+    return first;
+  }
+  // the line ends on the empty bin just past the tail
+  first = std::max(first - 1, 0);
+  last = std::min(last + 1, BINS - 1);
+
+  int peak = first;
+  for (int value = first; value <= last; value++) {
+    if (bins[value] > bins[peak]) {
+      peak = value;
+    }
+  }
+
+  // works on the long side, mirrored so it's always below the peak
+  bool flipped = peak - first < last - peak;
+  auto height = [&](int value) {
+    return (double)bins[flipped ? BINS - 1 - value : value];
+  };
+  int start = flipped ? BINS - 1 - last : first;
+  int top = flipped ? BINS - 1 - peak : peak;
+
+  // distance from the line (start, 0) to (top, peak height), up to a constant factor
+  double peakHeight = height(top);
+  int threshold = start;
+  double bestDistance = 0;
+  for (int value = start + 1; value <= top; value++) {
+    double distance = peakHeight * (value - start) - (top - start) * height(value);
+    if (distance > bestDistance) {
+      bestDistance = distance;
+      threshold = value;
+    }
+  }
+
+  // the value found starts the other class, mirrored back it's the split on the bright side
+  threshold--;
+  return flipped ? BINS - 1 - threshold : threshold;
+}
+
+std::array<unsigned char, Histogram::BINS> Histogram::equalizeTable(const Bins& bins) {
+  std::array<unsigned char, BINS> table;
+  long long total = 0;
+  for (long long count : bins) {
+    total += count;
+  }
+
+  // the lowest value present maps to 0 and the highest to 255
+  long long lowest = 0;
+  for (long long count : bins) {
+    if (count > 0) {
+      lowest = count;
+      break;
+    }
+  }
+  if (total == lowest) {
+    for (int value = 0; value < BINS; value++) {
+      table[value] = value;
+    }
+    return table;
+  }
+
+  long long cumulative = 0;
+  for (int value = 0; value < BINS; value++) {
+    cumulative += bins[value];
+    table[value] = std::clamp((int)((double)(cumulative - lowest) * 255 / (total - lowest) + 0.5), 0, 255);
+  }
+  return table;
+}
+
+std::array<unsigned char, Histogram::BINS> Histogram::clippedEqualizeTable(Bins bins, double clipLimit) {
+  long long total = 0;
+  for (long long count : bins) {
+    total += count;
+  }
+
+  long long limit = std::max<long long>(1, clipLimit * total / BINS);
+  long long excess = 0;
+  for (long long& count : bins) {
+    if (count > limit) {
+      excess += count - limit;
+      count = limit;
+    }
+  }
+  // whatever doesn't divide evenly goes one count each to bins spread across the range
+  long long share = excess / BINS;
+  long long remainder = excess % BINS;
+  for (int value = 0; value < BINS; value++) {
+    bins[value] += share + (value * remainder / BINS != (value + 1) * remainder / BINS);
+  }
+
+  std::array<unsigned char, BINS> table;
+  long long cumulative = 0;
+  for (int value = 0; value < BINS; value++) {
+    cumulative += bins[value];
+    table[value] = total > 0 ? std::clamp((int)((double)cumulative * 255 / total + 0.5), 0, 255) : value;
+  }
+  return table;
+}
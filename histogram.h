@@ -0,0 +1,35 @@
+#pragma once
+
+#include <array>
+
+// counts of each 8-bit value in an image, filled a span of pixels at a time so every thread can
+// fill its own and add them together at the end
+struct Histogram {
+  static const int BINS = 256;
+  static const int HUE_BINS = 360;
+  using Bins = std::array<long long, BINS>;
+
+  long long numPixels = 0;
+  // r, g and b, single channel images count their samples in all three
+  std::array<Bins, 3> channels = {};
+  // 709 luma exactly as PNM::grayscale computes it, the samples themselves for single channel images
+  Bins luminance = {};
+  // only filled when asked for, hue in whole degrees, saturation and lightness scaled to 0-255
+  bool hasHSL = false;
+  std::array<long long, HUE_BINS> hue = {};
+  Bins saturation = {};
+  Bins lightness = {};
+
+  // counts numPixels interleaved 8-bit pixels
+  void accumulate(const unsigned char* pixels, int numPixels, int numChannels, bool withHSL=false);
+  void add(const Histogram& other);
+
+  // last value of the darker class, picked to maximize the variance between the two classes
+  static int otsuThreshold(const Bins& bins);
+  // for one-sided histograms, the value farthest from the line between the peak and the end of the long tail
+  static int triangleThreshold(const Bins& bins);
+  // maps each value to its share of the cumulative count, spread over 0-255
+  static std::array<unsigned char, BINS> equalizeTable(const Bins& bins);
+  // bins above clipLimit times the mean bin are cut down first and the excess spread over every bin
+  static std::array<unsigned char, BINS> clippedEqualizeTable(Bins bins, double clipLimit);
+};
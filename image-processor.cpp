@@ -1,250 +1,773 @@
 #include "image-processor.h"
+#include "thread-pool.h"
+#include "instrumentation.h"
+#include "simd-kernels.h"
+#include "buffer-pool.h"
+#include "fft.h"
 #include <filesystem>
+#include <utility>
 
-// random number generator initialization
-std::random_device dev;
-std::default_random_engine rng(dev());
 
 // private
 
 
-void PNM::setMembers(std::filesystem::path filepath, int width, int height, int maxColor, int numChannels, vector<unsigned char> data) {
+void PNM::setMembers(std::filesystem::path filepath, int width, int height, int maxColor, int numChannels, PixelBuffer data) {
   this->filepath = filepath;
   this->width = width;
   this->height = height;
   this->maxColor = maxColor;
   this->numChannels = numChannels;
-  this->data = data;
+  this->bytesPerSample = maxColor > 255 ? 2 : 1;
+  this->data = std::move(data);
 }
-double PNM::normalRand(double sd, double mean) {
-  std::normal_distribution<double> normDist(mean, sd);
-  return normDist(rng);
-}
-int PNM::uniformRand(int min, int max) {
-  std::uniform_int_distribution<int> uniformDist(min, max);
-  return uniformDist(rng);
+
+template <typename Func>
+void PNM::dispatchPixelType(Func func) {
+  if (bytesPerSample == 2) {
+    if (numChannels == 3) {
+      func(static_cast<std::array<uint16_t, 3>*>(nullptr));
+    }
+    else {
+      func(static_cast<std::array<uint16_t, 1>*>(nullptr));
+    }
+  }
+  else if (numChannels == 3) {
+    func(static_cast<std::array<unsigned char, 3>*>(nullptr));
+  }
+  else {
+    func(static_cast<std::array<unsigned char, 1>*>(nullptr));
+  }
 }
 
-void PNM::saltNoise(float noiseDensity) {
-  if (numChannels != 1) {
+void PNM::reduceToEightBit() {
+  if (bytesPerSample == 1) {
     return;
   }
 
-  int numSalt = noiseDensity * width * height;
+  const uint16_t* samples = reinterpret_cast<const uint16_t*>(std::as_const(data).data());
+  vector<unsigned char> newImgData = BufferPool::acquire(data.size() / 2);
+  int rowLength = width * numChannels;
 
-  for (int i = 0; i < numSalt; i++) {
-    int randRow = uniformRand(0, height - 1);
-    int randCol = uniformRand(0, width - 1);
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    for (int i = rowBegin * rowLength; i < rowEnd * rowLength; i++) {
+      newImgData[i] = (std::min<int>(samples[i], maxColor) * 255 + maxColor / 2) / maxColor;
+    }
+  });
 
-    data[width * randRow + randCol] = 255;
+  maxColor = 255;
+  bytesPerSample = 1;
+  data = std::move(newImgData);
+}
+
+void PNM::swapSampleBytes(unsigned char* bytes, size_t size) {
+  for (size_t i = 0; i + 1 < size; i += 2) {
+    std::swap(bytes[i], bytes[i + 1]);
   }
 }
-void PNM::pepperNoise(float noiseDensity) {
-  if (numChannels != 1) {
+// adds amount times each noise value to count samples, rounded and clamped to 0-255
+// works on a whole block on the stack so the loop has a fixed length and vectorizes
+void PNM::addNoiseBlock(unsigned char* samples, int count, const float (&noise)[CounterRNG::BLOCK], float amount) {
+  unsigned char block[CounterRNG::BLOCK] = {};
+  std::memcpy(block, samples, count);
+  for (int i = 0; i < CounterRNG::BLOCK; i++) {
+    // rounds to nearest above -256, anything lower clamps to 0 either way
+    int offset = (int)(noise[i] * amount + 256.5f) - 256;
+    block[i] = std::clamp(block[i] + offset, 0, 255);
+  }
+  std::memcpy(samples, block, count);
+}
+
+// the gaps between noisy pixels are geometric, so only the pixels that change draw random values
+// each value gives the gap in its top 31 bits and salt or pepper in its lowest bit
+void PNM::impulseNoiseRow(unsigned char* pixels, int numPixels, int numChannels, const CounterRNG& rng, double density, bool salt, bool pepper) {
+  if (density <= 0) {
     return;
   }
+  double logMiss = std::log1p(-std::min(density, 1.0));
 
-  int numPepper = noiseDensity * width * height;
+  uint32_t bits[CounterRNG::BLOCK];
+  uint32_t block = 0;
+  int used = CounterRNG::BLOCK;
+  for (long long pixel = 0;; pixel++) {
+    if (used == CounterRNG::BLOCK) {
+      rng.bits(block++, bits);
+      used = 0;
+    }
+    uint32_t value = bits[used++];
 
-  for (int i = 0; i < numPepper; i++) {
-    int randRow = uniformRand(0, height - 1);
-    int randCol = uniformRand(0, width - 1);
+    // u is in (0, 1], every pixel is hit when the density is 1
+    double u = ((value >> 1) + 1.0) / 2147483648.0;
+    pixel += logMiss < -700 ? 0 : (long long)(std::log(u) / logMiss);
+    if (pixel >= numPixels) {
+      break;
+    }
 
-    data[width * randRow + randCol] = 0;
+    bool white = salt && (!pepper || (value & 1));
+    std::memset(pixels + pixel * numChannels, white ? 255 : 0, numChannels);
   }
 }
 
-void PNM::pixelClip(int pixIndex) {
-  if (data[pixIndex] > 255) {
-    data[pixIndex] = 255;
+// clamps every sample of a pixel to maxColor
+template <typename Pixel>
+void PNM::pixelClip(Pixel& pixel) {
+  for (auto& sample : pixel) {
+    if (sample > maxColor) {
+      sample = maxColor;
+    }
   }
-  else if (data[pixIndex] < 0) {
-    data[pixIndex] = 0;
+}
+
+template <typename Pixel>
+void PNM::pixelSwap(Pixel* pixels, int pixel1, int pixel2) {
+  Pixel temp = pixels[pixel1];
+  pixels[pixel1] = pixels[pixel2];
+  pixels[pixel2] = temp;
+}
+
+std::array<int, 3> PNM::pixelHSL(int pixIndex) const {
+  float hue, saturation, lightness;
+  float* const planes[3] = {&hue, &saturation, &lightness};
+  ColorPlanes::convertFromPixels(ColorSpace::HSL, &data[pixIndex], 1, numChannels, maxColor, planes);
+
+  const float ROUND = 0.5;
+  const int PERCENTAGE = 100;
+  return {(int)(hue + ROUND), (int)(saturation * PERCENTAGE + ROUND), (int)(lightness * PERCENTAGE + ROUND)};
+}
+
+vector<unsigned short> PNM::sortKeys(const string& sortCriteria, int& numKeys) {
+  int hslIndex = -1;
+  if (sortCriteria == "brightness" || sortCriteria == "luminance") {
+    numKeys = 256;
+  }
+  else if (sortCriteria == "hue") {
+    hslIndex = 0;
+    numKeys = 361;
+  }
+  else if (sortCriteria == "saturation" || sortCriteria == "lightness") {
+    hslIndex = sortCriteria == "saturation" ? 1 : 2;
+    numKeys = 101;
+  }
+  else {
+    numKeys = 0;
+    return {};
   }
 
-  if (numChannels == 3) {
-    if (data[pixIndex + 1] > 255) {
-      data[pixIndex + 1] = 255;
-    }
-    else if (data[pixIndex + 1] < 0) {
-      data[pixIndex + 1] = 0;
-    }
+  const unsigned char* pixels = std::as_const(data).data();
+  vector<unsigned short> keys((size_t)width * height);
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    // hue, saturation and lightness of a whole row at a time
+    vector<float> rowHSL(hslIndex >= 0 ? width * 3 : 0);
+    float* const planes[3] = {rowHSL.data(), rowHSL.data() + width, rowHSL.data() + 2 * width};
+
+    for (int row = rowBegin; row < rowEnd; row++) {
+      if (hslIndex >= 0) {
+        ColorPlanes::convertFromPixels(ColorSpace::HSL, pixels + (size_t)width * row * numChannels, width, numChannels, maxColor, planes);
+      }
+
+      for (int col = 0; col < width; col++) {
+        size_t index = (size_t)width * row + col;
+        int pixIdx = index * numChannels;
 
-    if (data[pixIndex + 2] > 255) {
-      data[pixIndex + 2] = 255;
+        if (hslIndex >= 0) {
+          // same rounding as pixelHSL
+          keys[index] = planes[hslIndex][col] * (hslIndex == 0 ? 1 : 100) + 0.5f;
+        }
+        else if (sortCriteria == "brightness") {
+          keys[index] = brightness(pixIdx);
+        }
+        else {
+          keys[index] = luminence(pixIdx);
+        }
+      }
     }
-    else if (data[pixIndex + 2] < 0) {
-      data[pixIndex + 2] = 0;
+  });
+  return keys;
+}
+
+void PNM::reverseRows(int rowBegin, int rowEnd) {
+  size_t rowLength = (size_t)width * numChannels * bytesPerSample;
+
+  for (int row = rowBegin; row < rowEnd; row++) {
+    unsigned char* rowPixels = &data[row * rowLength];
+    if (bytesPerSample == 1) {
+      SimdKernels::get().reverse(rowPixels, width, numChannels);
+      continue;
     }
 
+    dispatchPixelType([&]<typename Pixel>(Pixel*) {
+      Pixel* pixels = reinterpret_cast<Pixel*>(rowPixels);
+      std::reverse(pixels, pixels + width);
+    });
   }
 }
 
+void PNM::transposePixels(bool flipX, bool flipY) {
+  const int BLOCK_SIZE = 32;
+  int newWidth = height;
+  int newHeight = width;
+
+  vector<unsigned char> newImgData = BufferPool::acquire(data.size());
+
+  dispatchPixelType([&]<typename Pixel>(Pixel*) {
+    const Pixel* pixels = reinterpret_cast<const Pixel*>(std::as_const(data).data());
+    Pixel* newPixels = reinterpret_cast<Pixel*>(newImgData.data());
+
+    // a band of source rows fills a band of destination columns, 32x32 blocks keep both sides in cache
+    int numBands = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    ThreadPool::shared().parallelFor(numBands, [&](int bandBegin, int bandEnd) {
+      for (int band = bandBegin; band < bandEnd; band++) {
+        int rowBegin = band * BLOCK_SIZE;
+        int rowEnd = std::min(rowBegin + BLOCK_SIZE, height);
+
+        for (int colBegin = 0; colBegin < width; colBegin += BLOCK_SIZE) {
+          int colEnd = std::min(colBegin + BLOCK_SIZE, width);
+
+          for (int row = rowBegin; row < rowEnd; row++) {
+            int newCol = flipX ? newWidth - 1 - row : row;
+            for (int col = colBegin; col < colEnd; col++) {
+              int newRow = flipY ? newHeight - 1 - col : col;
+              newPixels[(size_t)newRow * newWidth + newCol] = pixels[(size_t)row * width + col];
+            }
+          }
+        }
+      }
+    });
+  });
 
-void PNM::pixelSwap(int pixIndex1, int pixIndex2, vector<unsigned char>& vec) {
-  unsigned int temp[numChannels];
+  width = newWidth;
+  height = newHeight;
+  data = std::move(newImgData);
+}
 
-  temp[0] = vec[pixIndex1];
-  if (numChannels == 3) {
-    temp[1] = vec[pixIndex1 + 1];
-    temp[2] = vec[pixIndex1 + 2];
+void PNM::orthogonalTransform(bool swapAxes, bool flipX, bool flipY) {
+  if (swapAxes) {
+    transposePixels(flipX, flipY);
+    return;
   }
+  size_t rowLength = (size_t)width * numChannels * bytesPerSample;
+  // unshares the pixels before any thread writes them
+  unsigned char* pixels = data.data();
+
+  if (flipX && !flipY) {
+    ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+      reverseRows(rowBegin, rowEnd);
+    });
+  }
+  else if (flipY) {
+    // swaps rows from both ends, a half turn also mirrors each pair while it's in cache
+    ThreadPool::shared().parallelFor((height + 1) / 2, [&](int rowBegin, int rowEnd) {
+      vector<unsigned char> temp(rowLength);
+
+      for (int row = rowBegin; row < rowEnd; row++) {
+        int mirrorRow = height - 1 - row;
+        if (flipX) {
+          reverseRows(row, row + 1);
+          if (mirrorRow != row) {
+            reverseRows(mirrorRow, mirrorRow + 1);
+          }
+        }
+        if (mirrorRow == row) { // middle row of an odd height
+          continue;
+        }
 
-  vec[pixIndex1] = vec[pixIndex2];
-  if (numChannels == 3) {
-    vec[pixIndex1 + 1] = vec[pixIndex2 + 1];
-    vec[pixIndex1 + 2] = vec[pixIndex2 + 2];
+        unsigned char* top = pixels + row * rowLength;
+        unsigned char* bottom = pixels + mirrorRow * rowLength;
+        std::memcpy(temp.data(), top, rowLength);
+        std::memcpy(top, bottom, rowLength);
+        std::memcpy(bottom, temp.data(), rowLength);
+      }
+    });
   }
+}
 
-  vec[pixIndex2] = temp[0];
-  if (numChannels == 3) {
-    vec[pixIndex2 + 1] = temp[1];
-    vec[pixIndex2 + 2] = temp[2];
+void PNM::warpPixels(const AffineTransform& transform, int newWidth, int newHeight, string interpolation) {
+  if (!transform.isInvertible() || newWidth < 1 || newHeight < 1) {
+    return;
   }
+
+  const int TILE_SIZE = 64;
+  AffineTransform inverse = transform.inverse();
+  bool bilinear = interpolation == "bilinear";
+
+  vector<unsigned char> newImgData = BufferPool::acquire((size_t)newWidth * newHeight * numChannels * bytesPerSample);
+
+  int tilesAcross = (newWidth + TILE_SIZE - 1) / TILE_SIZE;
+  int tilesDown = (newHeight + TILE_SIZE - 1) / TILE_SIZE;
+
+  dispatchPixelType([&]<typename Pixel>(Pixel*) {
+    using Sample = typename Pixel::value_type;
+    // 16-bit samples times two 8-bit weights need more than 32 bits
+    using Sum = std::conditional_t<sizeof(Sample) == 1, int, int64_t>;
+    constexpr int CHANNELS = std::tuple_size_v<Pixel>;
+    const Pixel* pixels = reinterpret_cast<const Pixel*>(std::as_const(data).data());
+    Pixel* newPixels = reinterpret_cast<Pixel*>(newImgData.data());
+
+    // rotations read the source diagonally, square output tiles keep the rows they touch in cache
+    ThreadPool::shared().parallelFor(tilesAcross * tilesDown, [&](int tileBegin, int tileEnd) {
+      for (int tile = tileBegin; tile < tileEnd; tile++) {
+        int top = tile / tilesAcross * TILE_SIZE;
+        int left = tile % tilesAcross * TILE_SIZE;
+        int bottom = std::min(top + TILE_SIZE, newHeight);
+        int right = std::min(left + TILE_SIZE, newWidth);
+
+        for (int row = top; row < bottom; row++) {
+          // source position of the first pixel center in the row, then stepped one column at a time
+          std::array<double, 2> source = inverse.apply(left + 0.5, row + 0.5);
+          double srcX = source[0];
+          double srcY = source[1];
+          Pixel* dst = &newPixels[(size_t)row * newWidth];
+
+          for (int col = left; col < right; col++, srcX += inverse.a, srcY += inverse.d) {
+            if (!(srcX >= 0 && srcX < width && srcY >= 0 && srcY < height)) {
+              dst[col] = Pixel{}; // outside the source, black
+              continue;
+            }
+
+            if (!bilinear) {
+              dst[col] = pixels[(int)srcY * width + (int)srcX];
+              continue;
+            }
+
+            // the four pixel centers around the sample point, edge pixels cover the outer half pixel
+            // u and v are at least -0.5, so truncating after adding 1 floors them
+            double u = srcX - 0.5;
+            double v = srcY - 0.5;
+            int x0 = (int)(u + 1) - 1;
+            int y0 = (int)(v + 1) - 1;
+            // 8 bit fractions, rounded so samples landing on a pixel center take exactly that pixel
+            int weightX = (u - x0) * 256 + 0.5;
+            int weightY = (v - y0) * 256 + 0.5;
+            int x1 = std::min(x0 + 1, width - 1);
+            int y1 = std::min(y0 + 1, height - 1);
+            x0 = std::max(x0, 0);
+            y0 = std::max(y0, 0);
+
+            const Pixel& topLeft = pixels[y0 * width + x0];
+            const Pixel& topRight = pixels[y0 * width + x1];
+            const Pixel& bottomLeft = pixels[y1 * width + x0];
+            const Pixel& bottomRight = pixels[y1 * width + x1];
+
+            Pixel sampled;
+            for (int channel = 0; channel < CHANNELS; channel++) {
+              Sum upper = topLeft[channel] * (256 - weightX) + topRight[channel] * weightX;
+              Sum lower = bottomLeft[channel] * (256 - weightX) + bottomRight[channel] * weightX;
+              sampled[channel] = (upper * (256 - weightY) + lower * weightY + 32768) >> 16;
+            }
+            dst[col] = sampled;
+          }
+        }
+      }
+    });
+  });
+
+  width = newWidth;
+  height = newHeight;
+  data = std::move(newImgData);
 }
 
-vector<int> PNM::pixelHSL(int pixIndex) {
-  if (numChannels == 1) {
-    return {0, 0, 0};
-  }
-
-  double r = data[pixIndex];
-  double g = data[pixIndex + 1];
-  double b = data[pixIndex + 2];
-  vector<double> channels = {r, g, b};
-
-  // normalize channels to 0-1
-  channels[0] /= maxColor;
-  channels[1] /= maxColor;
-  channels[2] /= maxColor;
- 
-  vector<double> sortedChannels = channels;
-  std::sort(sortedChannels.begin(), sortedChannels.end());
-  const double ROUND = 0.5;
-  const int DEGREES = 60;
-  const int PERCENTAGE = 100;
+double PNM::gaussian(int row, int col, double sd) {
+  double ePower = -((col * col + row * row) / (2 * sd * sd));
+  double mainFrac = 1 / (2 * std::numbers::pi * sd * sd);
 
-  // calculates chroma and lightness
-  double min = sortedChannels[0];
-  double max = sortedChannels[2];
-  double chroma = max - min;
-  int lightness = ((max + min) / 2) * PERCENTAGE + ROUND;
+  return mainFrac * exp(ePower); 
+}
 
-  // calculates saturation and hue
-  int saturation = 0;
-  int hue = 0;
-  if (chroma != 0) {
-    if (lightness <= 50) {
-      saturation = ((chroma) / (max + min)) * PERCENTAGE + ROUND;
-    }
-    else {
-      saturation = ((chroma) / (2 - chroma)) * PERCENTAGE + ROUND;
-    }
 
-    if (max == channels[0]) {
-      hue = ((channels[1] - channels[2]) / chroma) * DEGREES + ROUND;
-    }
-    else if (max == channels[1]) {
-      hue = (2 + (channels[2] - channels[0]) / (chroma)) * DEGREES + ROUND;
-    }
-    else if (max == channels[2]) {
-      hue = (4 + (channels[0] - channels[1]) / (chroma)) * DEGREES + ROUND;
-    }
-    
-    // esures hue is non-negative and 0 to 360 degrees
-    if (hue < 0) {
-      hue += 360;
+vector<int> PNM::borderIndices(int size, int radius, string borderMode) {
+  vector<int> indices(size + 2 * radius);
+
+  for (int i = 0; i < indices.size(); i++) {
+    int index = i - radius;
+
+    if (index < 0 || index >= size) {
+      if (borderMode == "zero") {
+        index = -1;
+      }
+      else if (borderMode == "wrap") {
+        index = ((index % size) + size) % size;
+      }
+      else if (borderMode == "reflect") { // mirrors including the edge pixel, cba|abc
+        int period = 2 * size;
+        index = ((index % period) + period) % period;
+        if (index >= size) {
+          index = period - 1 - index;
+        }
+      }
+      else { // clamp
+        index = std::clamp(index, 0, size - 1);
+      }
     }
+    indices[i] = index;
   }
-
-  return {hue, saturation, lightness};
+  return indices;
 }
 
-int PNM::partition(vector<unsigned char>& vec, int low, int high) {
-  int middle = low + (3 * ((high - low) / 6));
-  int pivot = vec[middle];
-  int i = low - 3;
-  int j = high + 3;
 
-  while (true) {
-    do {
-      i += 3;
-    } while (vec[i] < pivot);
+// separable running sums, cost per pixel doesn't depend on the radius
+vector<unsigned char> PNM::meanBlur(int radius, string borderMode/*="clamp"*/) {
+  if (radius < 1) {
+    return data;
+  }
+
+  vector<unsigned char> newImgData = BufferPool::acquire(data.size());
+  int kernalSize = 2 * radius + 1;
+  int kernalArea = kernalSize * kernalSize;
+
+  vector<int> colIndices = borderIndices(width, radius, borderMode);
+  vector<int> rowIndices = borderIndices(height, radius, borderMode);
+
+  dispatchPixelType([&]<typename Pixel>(Pixel*) {
+    using Sample = typename Pixel::value_type;
+    // window sums of 16-bit samples overflow 32 bits past a radius of about 127
+    using Sum = std::conditional_t<sizeof(Sample) == 1, unsigned int, uint64_t>;
+    constexpr int CHANNELS = std::tuple_size_v<Pixel>;
+    int rowLength = width * CHANNELS;
+
+    const Sample* samples = reinterpret_cast<const Sample*>(std::as_const(data).data());
+    Sample* blurred = reinterpret_cast<Sample*>(newImgData.data());
+
+    // horizontal pass, window sums along each row
+    vector<Sum> rowSums((size_t)height * rowLength);
+    Instrumentation::recordAllocation(rowSums.size() * sizeof(Sum));
+    ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+      for (int row = rowBegin; row < rowEnd; row++) {
+        const Sample* src = &samples[row * rowLength];
+        Sum* dst = &rowSums[row * rowLength];
+
+        Sum sum[CHANNELS] = {};
+        for (int k = 0; k < kernalSize; k++) {
+          if (colIndices[k] >= 0) {
+            for (int channel = 0; channel < CHANNELS; channel++) {
+              sum[channel] += src[colIndices[k] * CHANNELS + channel];
+            }
+          }
+        }
+        for (int channel = 0; channel < CHANNELS; channel++) {
+          dst[channel] = sum[channel];
+        }
 
-    do {
-      j -= 3;
-    } while (vec[j] > pivot); 
+        for (int col = 1; col < width; col++) {
+          int added = colIndices[col + 2 * radius];
+          int removed = colIndices[col - 1];
+
+          for (int channel = 0; channel < CHANNELS; channel++) {
+            if (added >= 0) {
+              sum[channel] += src[added * CHANNELS + channel];
+            }
+            if (removed >= 0) {
+              sum[channel] -= src[removed * CHANNELS + channel];
+            }
+            dst[col * CHANNELS + channel] = sum[channel];
+          }
+        }
+      }
+    });
+
+    // vertical pass, slides a row of column sums down each band of rows
+    // every band starts by summing its own halo so the sums match the serial pass exactly
+    ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+      vector<Sum> colSums(rowLength, 0);
+      for (int k = 0; k < kernalSize; k++) {
+        int haloRow = rowIndices[rowBegin + k];
+        if (haloRow >= 0) {
+          const Sum* src = &rowSums[haloRow * rowLength];
+          for (int i = 0; i < rowLength; i++) {
+            colSums[i] += src[i];
+          }
+        }
+      }
 
-    if (i >= j) {return j;}
+      for (int row = rowBegin; row < rowEnd; row++) {
+        Sample* dst = &blurred[row * rowLength];
+        for (int i = 0; i < rowLength; i++) {
+          dst[i] = (colSums[i] + kernalArea / 2) / kernalArea;
+        }
 
-    pixelSwap(i, j, vec);
-  }
+        if (row + 1 < rowEnd) {
+          int added = rowIndices[row + 1 + 2 * radius];
+          int removed = rowIndices[row];
+
+          if (added >= 0) {
+            const Sum* src = &rowSums[added * rowLength];
+            for (int i = 0; i < rowLength; i++) {
+              colSums[i] += src[i];
+            }
+          }
+          if (removed >= 0) {
+            const Sum* src = &rowSums[removed * rowLength];
+            for (int i = 0; i < rowLength; i++) {
+              colSums[i] -= src[i];
+            }
+          }
+        }
+      }
+    });
+  });
+  return newImgData;
 }
-void PNM::quickSort(vector<unsigned char>& vec, int low, int high) {
-  if (low < high) {
-    int pivot = partition(vec, low, high);
-    quickSort(vec, low, pivot);
-    quickSort(vec, pivot + 3, high);
+
+// separable kernel, horizontal pass into a float buffer then vertical pass a row at a time
+vector<unsigned char> PNM::gaussianBlur(int radius, string borderMode/*="clamp"*/) {
+  if (radius < 1) {
+    return data;
   }
-}
 
+  int kernalSize = 2 * radius + 1;
+  int rowLength = width * numChannels;
+  double sd = 0.3 * (radius - 1) + 0.8;
+
+  // gaussian() is separable so its values along a single row give the 1-D kernel
+  vector<float> kernal(kernalSize);
+  double kernalSum = 0;
+  for (int k = 0; k < kernalSize; k++) {
+    kernalSum += gaussian(0, k - radius, sd);
+  }
+  for (int k = 0; k < kernalSize; k++) {
+    kernal[k] = gaussian(0, k - radius, sd) / kernalSum;
+  }
+
+  vector<int> colIndices = borderIndices(width, radius, borderMode);
+  vector<int> rowIndices = borderIndices(height, radius, borderMode);
+
+  // horizontal pass
+  const unsigned char* pixels = std::as_const(data).data();
+  vector<unsigned char> horizontalBuffer = BufferPool::acquire(data.size() * sizeof(float));
+  float* horizontal = reinterpret_cast<float*>(horizontalBuffer.data());
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    vector<float> paddedRow((width + 2 * radius) * numChannels);
+    for (int row = rowBegin; row < rowEnd; row++) {
+      const unsigned char* src = pixels + row * rowLength;
+
+      for (int i = 0; i < colIndices.size(); i++) {
+        for (int channel = 0; channel < numChannels; channel++) {
+          paddedRow[i * numChannels + channel] = colIndices[i] >= 0 ? src[colIndices[i] * numChannels + channel] : 0;
+        }
+      }
 
-vector<int> PNM::rotateCoordinates(int row, int col, double theta) {
-  vector<int> coordinates(2);
-  coordinates[0] = std::floor(col * std::sin(theta) + row * std::cos(theta));
-  coordinates[1] = std::floor(col * std::cos(theta) - row * std::sin(theta));
+      float* dst = &horizontal[row * rowLength];
+      for (int i = 0; i < rowLength; i++) {
+        float sum = 0;
+        for (int k = 0; k < kernalSize; k++) {
+          sum += kernal[k] * paddedRow[i + k * numChannels];
+        }
+        dst[i] = sum;
+      }
+    }
+  });
+
+  // vertical pass
+  vector<unsigned char> newImgData = BufferPool::acquire(data.size());
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    vector<float> rowSum(rowLength);
+    for (int row = rowBegin; row < rowEnd; row++) {
+      std::fill(rowSum.begin(), rowSum.end(), 0);
+
+      for (int k = 0; k < kernalSize; k++) {
+        if (rowIndices[row + k] < 0) {
+          continue;
+        }
+        const float* src = &horizontal[rowIndices[row + k] * rowLength];
+        for (int i = 0; i < rowLength; i++) {
+          rowSum[i] += kernal[k] * src[i];
+        }
+      }
 
-  return coordinates;
+      unsigned char* dst = &newImgData[row * rowLength];
+      for (int i = 0; i < rowLength; i++) {
+        dst[i] = std::min(rowSum[i] + 0.5f, 255.0f);
+      }
+    }
+  });
+  BufferPool::recycle(std::move(horizontalBuffer));
+  return newImgData;
 }
 
-double PNM::gaussian(int row, int col, double sd) {
-  double ePower = -((col * col + row * row) / (2 * sd * sd));
-  double mainFrac = 1 / (2 * std::numbers::pi * sd * sd);
+vector<unsigned char> PNM::fastGaussianBlur(int radius, string borderMode/*="clamp"*/) {
+  if (radius < 1) {
+    return data;
+  }
 
-  return mainFrac * exp(ePower); 
+  // box sizes whose combined variance matches the gaussian's
+  const int PASSES = 3;
+  double sd = 0.3 * (radius - 1) + 0.8;
+  int lowerSize = std::sqrt(12 * sd * sd / PASSES + 1);
+  if (lowerSize % 2 == 0) {
+    lowerSize--;
+  }
+  int upperSize = lowerSize + 2;
+  int numLower = std::round((12 * sd * sd - PASSES * lowerSize * lowerSize - 4 * PASSES * lowerSize - 3 * PASSES) / (-4 * lowerSize - 4));
+
+  // shares the pixels, the passes replace data rather than writing to it
+  PixelBuffer original = data;
+  for (int i = 0; i < PASSES; i++) {
+    int boxSize = i < numLower ? lowerSize : upperSize;
+    data = meanBlur((boxSize - 1) / 2, borderMode);
+  }
+
+  vector<unsigned char> newImgData = data.release();
+  data = std::move(original);
+  return newImgData;
 }
 
+// perreault and hebert's constant-time median, every column keeps a histogram of the 2r+1 samples
+// above and below the current row, and the window's histogram slides along the row adding one column
+// and removing another
+// histograms are two-level, 16 coarse bins of 16 values each, the window's coarse bins are always
+// current while its fine bins are only caught up for the coarse bin the median lands in
+vector<unsigned char> PNM::medianBlur(int radius, string borderMode/*="clamp"*/) {
+  if (radius < 1) {
+    return data;
+  }
 
-vector<unsigned char> PNM::meanBlur(int radius) {
-  vector<unsigned char> newImgData = data;
+  const int BINS = 256;
+  const int COARSE = 16;
+  const int FINE = BINS / COARSE;
   int kernalSize = 2 * radius + 1;
-  vector<vector<int>> kernal(kernalSize, vector<int>(kernalSize));
+  // the median is the first value with more than half the window at or below it
+  long long half = (long long)kernalSize * kernalSize / 2;
+
+  vector<int> colIndices = borderIndices(width, radius, borderMode);
+  vector<int> rowIndices = borderIndices(height, radius, borderMode);
+  // zero padding reads an extra column past the image whose histogram only counts zeros
+  for (int& index : colIndices) {
+    index = index < 0 ? width : index;
+  }
+
+  const unsigned char* pixels = std::as_const(data).data();
+  vector<unsigned char> newImgData = BufferPool::acquire(data.size());
+  int rowLength = width * numChannels;
+
+  // each band builds its column histograms from its own halo rows, so a band needs at least a window
+  // of rows to be worth the start-up
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    // column histograms of each channel, [channel][column][bin]
+    vector<uint16_t> colFine((size_t)numChannels * (width + 1) * BINS, 0);
+    vector<uint16_t> colCoarse((size_t)numChannels * (width + 1) * COARSE, 0);
+    auto countSample = [&](int channel, int col, int value, int change) {
+      size_t column = (size_t)channel * (width + 1) + col;
+      colFine[column * BINS + value] += change;
+      colCoarse[column * COARSE + value / FINE] += change;
+    };
+    auto countRow = [&](int row, int change) {
+      const unsigned char* src = pixels + (size_t)row * rowLength;
+      for (int channel = 0; channel < numChannels; channel++) {
+        for (int col = 0; col < width; col++) {
+          countSample(channel, col, row >= 0 ? src[col * numChannels + channel] : 0, change);
+        }
+      }
+    };
 
-  for (int row = radius; row < height - radius; row++) {
-    for (int col = radius; col < width - radius; col++) {
+    for (int channel = 0; channel < numChannels; channel++) {
+      countSample(channel, width, 0, kernalSize);
+    }
+    for (int k = 0; k < kernalSize; k++) {
+      countRow(rowIndices[rowBegin + k], 1);
+    }
 
-      vector<int> channelSum(numChannels);
-      for (int kernalRow = -radius; kernalRow <= radius; kernalRow++) {
-        for (int kernalCol = -radius; kernalCol <= radius; kernalCol++) {
-          int kernalPixelIndex = (width * (row + kernalRow) + (col + kernalCol)) * numChannels;
+    uint32_t kernalCoarse[COARSE];
+    uint32_t kernalFine[BINS];
+    // column each fine bin was last caught up to, -1 if never
+    int fineColumn[COARSE];
+    for (int row = rowBegin; row < rowEnd; row++) {
+      if (row > rowBegin) {
+        countRow(rowIndices[row - 1], -1);
+        countRow(rowIndices[row + 2 * radius], 1);
+      }
 
-          channelSum[0] += data[kernalPixelIndex];
-          if (numChannels == 3) {
-            channelSum[1] += data[kernalPixelIndex + 1];
-            channelSum[2] += data[kernalPixelIndex + 2];
-          }
+      unsigned char* dst = &newImgData[(size_t)row * rowLength];
+      for (int channel = 0; channel < numChannels; channel++) {
+        const uint16_t* fine = &colFine[(size_t)channel * (width + 1) * BINS];
+        const uint16_t* coarse = &colCoarse[(size_t)channel * (width + 1) * COARSE];
 
+        std::fill(kernalCoarse, kernalCoarse + COARSE, 0);
+        for (int k = 0; k < kernalSize; k++) {
+          const uint16_t* column = &coarse[colIndices[k] * COARSE];
+          for (int bin = 0; bin < COARSE; bin++) {
+            kernalCoarse[bin] += column[bin];
+          }
         }
-      }
-      int pixelIndex = (width * row + col) * numChannels;
+        std::fill(fineColumn, fineColumn + COARSE, -1);
+
+        for (int col = 0; col < width; col++) {
+          if (col > 0) {
+            const uint16_t* added = &coarse[colIndices[col + 2 * radius] * COARSE];
+            const uint16_t* removed = &coarse[colIndices[col - 1] * COARSE];
+            for (int bin = 0; bin < COARSE; bin++) {
+              kernalCoarse[bin] += added[bin] - removed[bin];
+            }
+          }
+
+          long long below = 0;
+          int bin = 0;
+          while (below + kernalCoarse[bin] <= half) {
+            below += kernalCoarse[bin];
+            bin++;
+          }
+
+          // catches the fine bins under this coarse bin up to the current window, a window's worth of
+          // columns behind is as much work as starting over
+          uint32_t* kernalBin = &kernalFine[bin * FINE];
+          if (fineColumn[bin] < 0 || col - fineColumn[bin] > 2 * radius) {
+            std::fill(kernalBin, kernalBin + FINE, 0);
+            for (int k = col; k <= col + 2 * radius; k++) {
+              const uint16_t* column = &fine[colIndices[k] * BINS + bin * FINE];
+              for (int value = 0; value < FINE; value++) {
+                kernalBin[value] += column[value];
+              }
+            }
+          }
+          else {
+            for (int k = fineColumn[bin] + 1; k <= col; k++) {
+              const uint16_t* added = &fine[colIndices[k + 2 * radius] * BINS + bin * FINE];
+              const uint16_t* removed = &fine[colIndices[k - 1] * BINS + bin * FINE];
+              for (int value = 0; value < FINE; value++) {
+                kernalBin[value] += added[value] - removed[value];
+              }
+            }
+          }
+          fineColumn[bin] = col;
 
-      newImgData[pixelIndex] = channelSum[0] / (kernalSize * kernalSize);
-      if (numChannels == 3) {
-        newImgData[pixelIndex + 1] = channelSum[1] / (kernalSize * kernalSize);
-        newImgData[pixelIndex + 2] = channelSum[2] / (kernalSize * kernalSize);
+          int value = 0;
+          while (below + kernalBin[value] <= half) {
+            below += kernalBin[value];
+            value++;
+          }
+          dst[col * numChannels + channel] = bin * FINE + value;
+        }
       }
     }
-  }
+  }, kernalSize);
   return newImgData;
 }
 
+bool PNM::readHeader(std::fstream& fin) {
+  string magicNumber;
+  fin >> magicNumber;
+  if (magicNumber != "P6" && magicNumber != "P5") {
+    std::cerr << "Error: Incorrect file type, not PPM P5 or P6" << std::endl;
+    return false;
+  }
+  if (magicNumber == "P6") {
+    numChannels = 3;
+  }
+  else {
+    numChannels = 1;
+  }
+
+  fin >> width >> height >> maxColor;
+  fin.ignore(1); // ignores newline after max color;
+  bytesPerSample = maxColor > 255 ? 2 : 1;
+
+  return true;
+}
+
 // public
 PNM::PNM() {}
 PNM::PNM(const std::filesystem::path& filepath) {
   read(filepath);
 }
 
-bool PNM::read(const std::filesystem::path& filepath) {
+bool PNM::read(const std::filesystem::path& filepath, bool memoryMap/*=false*/) {
   std::fstream fin;
   fin.open(filepath, std::ios::in | std::ios::binary);
 
@@ -253,41 +776,68 @@ bool PNM::read(const std::filesystem::path& filepath) {
     return false;
   }
 
-  string magicNumber;
-  fin >> magicNumber;
-  if (magicNumber != "P6" && magicNumber != "P5") {
-    std::cerr << "Error: Incorrect file type, not PPM P5 or P6" << std::endl;
+  InstrumentedScope scope("read");
+  if (!readHeader(fin)) {
     return false;
   }
-  if (magicNumber == "P6") {
-    numChannels = 3;
-  }
-  else {
-    numChannels = 1;
-  }
-
   this->filepath = filepath;
-  fin >> width >> height >> maxColor;
-  fin.ignore(1); // ignores newline after max color;
+  scope.setPixels((long long)width * height);
+
+  // maps the payload instead of copying it, falls back to reading if mapping fails
+  // 16-bit samples have to be byte swapped so they're always read
+  size_t payloadSize = (size_t)width * height * numChannels * bytesPerSample;
+  size_t payloadOffset = fin.tellg();
+  if (memoryMap && bytesPerSample == 1 && std::filesystem::file_size(filepath) >= payloadOffset + payloadSize) {
+    if (data.map(filepath, payloadOffset, payloadSize)) {
+      fin.close();
+      return true;
+    }
+  }
 
-  data.resize(width * height * numChannels);
+  // the old pixels go back to the buffer pool first, so reading into the same image can reuse them
+  data = PixelBuffer();
+  data = BufferPool::acquire(payloadSize);
   fin.read(reinterpret_cast<char*>(data.data()), data.size()); 
+  scope.addBytesRead(fin.gcount());
   if (!fin) {
     std::cerr << "Error: Failed to read pixel data" << std::endl;
     return false;
   }
   fin.close();
 
+  if (bytesPerSample == 2 && std::endian::native == std::endian::little) {
+    swapSampleBytes(data.data(), data.size());
+  }
+
   return true;
 }
 
 bool PNM::write() {
-  return write(filepath, data, width, height, maxColor, numChannels);
+  return write(filepath, false);
 }
 bool PNM::write(const std::filesystem::path& filepath) {
-  return write(filepath, data, width, height, maxColor, numChannels);
+  return write(filepath, false);
+}
+bool PNM::write(const std::filesystem::path& filepath, bool memoryMap) {
+  size_t stride = (size_t)width * numChannels * bytesPerSample;
+  return writeFile(filepath, std::as_const(data).data(), stride, width, height, maxColor, numChannels, memoryMap);
+}
+bool PNM::write(const std::filesystem::path& filepath, const vector<unsigned char>& data, int width, int height, int maxColor, int numChannels) {
+  size_t stride = (size_t)width * numChannels * (maxColor > 255 ? 2 : 1);
+  return writeFile(filepath, data.data(), stride, width, height, maxColor, numChannels, false);
+}
+bool PNM::write(const std::filesystem::path& filepath, const ImageView& view, int maxColor/*=255*/) {
+  if (view.empty() || view.bytesPerSample != (maxColor > 255 ? 2 : 1)) {
+    std::cerr << "Error: Can't write an empty view or one whose samples don't match maxColor" << std::endl;
+    return false;
+  }
+  return writeFile(filepath, view.origin, view.stride, view.width, view.height, maxColor, view.numChannels, false);
 }
-bool PNM::write(const std::filesystem::path& filepath, vector<unsigned char> data, int width, int height, int maxColor, int numChannels) {
+bool PNM::writeFile(const std::filesystem::path& filepath, const unsigned char* pixels, size_t stride, int width, int height, int maxColor, int numChannels, bool memoryMap) {
+  InstrumentedScope scope("write", (long long)width * height);
+  size_t rowSize = (size_t)width * numChannels * (maxColor > 255 ? 2 : 1);
+  size_t size = rowSize * height;
+  bool contiguous = stride == rowSize;
   std::fstream fout;
 
   // assumes output path is cwd if only filename given
@@ -313,6 +863,33 @@ bool PNM::write(const std::filesystem::path& filepath, vector<unsigned char> dat
     outputPath.replace_extension(".pgm");
   }
 
+  // truncating the file we're mapped from would pull the pixels out from under us
+  // that includes views into the mapping, and copies of this image sharing it
+  if (data.isMappedFrom(outputPath)) {
+    const unsigned char* mapped = std::as_const(data).data();
+    bool ownPixels = pixels >= mapped && pixels < mapped + data.size();
+    data.detach();
+    if (ownPixels) {
+      pixels = std::as_const(data).data() + (pixels - mapped);
+    }
+  }
+
+  // 16-bit samples are big-endian in the file
+  bool swapBytes = maxColor > 255 && std::endian::native == std::endian::little;
+
+  // file header
+  string header;
+  if (numChannels == 3) {
+    header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n" + std::to_string(maxColor) + "\n";
+  }
+  else {
+    header = "P5\n" + std::to_string(width) + " " + std::to_string(height) + "\n" + std::to_string(maxColor) + "\n";
+  }
+
+  if (memoryMap && contiguous && !swapBytes && PixelBuffer::mapWrite(outputPath, header, pixels, size)) {
+    scope.addBytesWritten(header.size() + size);
+    return true;
+  }
 
   fout.open(outputPath, std::ios::out | std::ios::binary);
 
@@ -321,19 +898,42 @@ bool PNM::write(const std::filesystem::path& filepath, vector<unsigned char> dat
     return false;
   }
 
-  // file header
-  if (numChannels == 3) {
-    fout << "P6\n" << width << " " << height << "\n" << maxColor << "\n";
+  fout << header;
+  if (contiguous && !swapBytes) {
+    fout.write(reinterpret_cast<const char*>(pixels), size);
   }
   else {
-    fout << "P5\n" << width << " " << height << "\n" << maxColor << "\n";
+    // views are written a row at a time, 16-bit rows are swapped in a row sized buffer
+    vector<unsigned char> rowBuffer(swapBytes ? rowSize : 0);
+    for (int row = 0; row < height; row++) {
+      const unsigned char* rowPixels = pixels + row * stride;
+      if (swapBytes) {
+        std::memcpy(rowBuffer.data(), rowPixels, rowSize);
+        swapSampleBytes(rowBuffer.data(), rowSize);
+        rowPixels = rowBuffer.data();
+      }
+      fout.write(reinterpret_cast<const char*>(rowPixels), rowSize);
+    }
   }
-
-  fout.write(reinterpret_cast<char*>(data.data()), data.size());
   fout.close();
+  scope.addBytesWritten(header.size() + size);
 
   return true;
 }
+ImageView PNM::view() {
+  return view({0, 0}, width, height);
+}
+ImageView PNM::view(std::array<int, 2> upperLeft, int viewWidth, int viewHeight) {
+  ImageView whole;
+  whole.origin = data.data();
+  whole.width = width;
+  whole.height = height;
+  whole.stride = (size_t)width * numChannels * bytesPerSample;
+  whole.numChannels = numChannels;
+  whole.bytesPerSample = bytesPerSample;
+  return whole.crop(upperLeft[0], upperLeft[1], viewWidth, viewHeight);
+}
+
 int PNM::getWidth() {
   return width;
 }
@@ -343,6 +943,55 @@ int PNM::getHeight() {
 int PNM::getNumChannels() {
   return numChannels;
 }
+int PNM::getBytesPerSample() {
+  return bytesPerSample;
+}
+
+void PNM::setNumThreads(int numThreads) {
+  ThreadPool::shared().setNumThreads(numThreads);
+}
+int PNM::getNumThreads() {
+  return ThreadPool::shared().getNumThreads();
+}
+
+vector<uint64_t> PNM::integralImage() {
+  InstrumentedScope scope("integralImage", (long long)width * height);
+  int tableWidth = width + 1;
+  vector<uint64_t> table(tableWidth * (height + 1) * numChannels, 0);
+
+  dispatchPixelType([&]<typename Pixel>(Pixel*) {
+    constexpr int CHANNELS = std::tuple_size_v<Pixel>;
+    const Pixel* pixels = reinterpret_cast<const Pixel*>(std::as_const(data).data());
+
+    for (int row = 1; row <= height; row++) {
+      uint64_t rowSum[CHANNELS] = {};
+
+      for (int col = 1; col <= width; col++) {
+        const Pixel& pixel = pixels[width * (row - 1) + (col - 1)];
+        int tableIndex = (tableWidth * row + col) * CHANNELS;
+        int aboveIndex = tableIndex - tableWidth * CHANNELS;
+
+        for (int channel = 0; channel < CHANNELS; channel++) {
+          rowSum[channel] += pixel[channel];
+          table[tableIndex + channel] = table[aboveIndex + channel] + rowSum[channel];
+        }
+      }
+    }
+  });
+  return table;
+}
+uint64_t PNM::regionSum(const vector<uint64_t>& table, int row, int col, int regionHeight, int regionWidth, int channel/*=0*/) {
+  int tableWidth = width + 1;
+  int top = row;
+  int left = col;
+  int bottom = row + regionHeight;
+  int right = col + regionWidth;
+
+  return table[(tableWidth * bottom + right) * numChannels + channel]
+       - table[(tableWidth * top + right) * numChannels + channel]
+       - table[(tableWidth * bottom + left) * numChannels + channel]
+       + table[(tableWidth * top + left) * numChannels + channel];
+}
 
 void PNM::setWidth(int width) {
   this->width = width;
@@ -351,54 +1000,39 @@ void PNM::setHeight(int height) {
   this->height = height;
 }
 
-void PNM::setAllRChannels(int value) {
-  if (value > 255) {
-    value = 255;
-  }
-  else if (value < 0) {
-    value = 0;
-  }
-
-  for (int i = 0; i < data.size(); i += 3) {
-    data[i] = value;
-  }
-}
-void PNM::setAllGChannels(int value) {
+// sets one channel of every pixel, 16-bit images take values up to maxColor
+void PNM::setChannel(int channel, int value) {
   if (numChannels != 3) {
     return;
   }
-  if (value > 255) {
-    value = 255;
-  }
-  else if (value < 0) {
-    value = 0;
-  }
+  value = std::clamp(value, 0, bytesPerSample == 2 ? maxColor : 255);
 
-  for (int i = 1; i < data.size(); i += 3) {
-    data[i] = value;
-  }
+  dispatchPixelType([&]<typename Pixel>(Pixel*) {
+    Pixel* pixels = reinterpret_cast<Pixel*>(data.data());
+    int numPixels = width * height;
 
+    for (int i = 0; i < numPixels; i++) {
+      pixels[i][channel] = value;
+    }
+  });
 }
-void PNM::setAllBChannels(int value) {
-  if (numChannels != 3) {
-    return;
-  }
-  if (value > 255) {
-    value = 255;
-  }
-  else if (value < 0) {
-    value = 0;
-  }
-
-  for (int i = 2; i < data.size(); i += 3) {
-    data[i] = value;
-  }
 
+void PNM::setAllRChannels(int value) {
+  InstrumentedScope scope("setAllRChannels", (long long)width * height);
+  setChannel(0, value);
+}
+void PNM::setAllGChannels(int value) {
+  InstrumentedScope scope("setAllGChannels", (long long)width * height);
+  setChannel(1, value);
+}
+void PNM::setAllBChannels(int value) {
+  InstrumentedScope scope("setAllBChannels", (long long)width * height);
+  setChannel(2, value);
 }
 
 // image filters
 
-int PNM::brightness(int pixIndex) {
+int PNM::brightness(int pixIndex) const {
   if (numChannels == 1) {
     return data[pixIndex];
   }
@@ -406,7 +1040,7 @@ int PNM::brightness(int pixIndex) {
   return (data[pixIndex] + data[pixIndex + 1] + data[pixIndex + 2]) / numChannels;
 }
 
-int PNM::luminence(int pixIndex, int standard/*=709*/) {
+int PNM::luminence(int pixIndex, int standard/*=709*/) const {
   if (numChannels == 1) {
     return data[pixIndex];
   }
@@ -428,97 +1062,162 @@ int PNM::luminence(int pixIndex, int standard/*=709*/) {
   return data[pixIndex] * magicWeightR + data[pixIndex + 1] * magicWeightG + data[pixIndex + 2] * magicWeightB;
 }
 
+// per-pixel kernels over a contiguous run of pixels, shared by the filters and Pipeline
+// they forward to the widest SIMD variant the CPU supports
+
+void PNM::grayscaleSpan(const unsigned char* src, unsigned char* dst, int numPixels, int standard) {
+  SimdKernels::get().grayscale(src, dst, numPixels, standard);
+}
+
+void PNM::invertSpan(unsigned char* samples, int numSamples, int maxColor) {
+  SimdKernels::get().invert(samples, numSamples, maxColor);
+}
+
+void PNM::sepiaSpan(unsigned char* pixels, int numPixels) {
+  SimdKernels::get().sepia(pixels, numPixels);
+}
+
+// r, g and b are already normalized to 0-1
+void PNM::tintSpan(unsigned char* pixels, int numPixels, float r, float g, float b, float brightness) {
+  SimdKernels::get().tint(pixels, numPixels, r, g, b, brightness);
+}
+
+void PNM::thresholdSpan(unsigned char* samples, int numSamples, int epsilon) {
+  SimdKernels::get().threshold(samples, numSamples, epsilon);
+}
+
+void PNM::channelSwapSpan(unsigned char* pixels, int numPixels, int channelOffset1, int channelOffset2) {
+  SimdKernels::get().channelSwap(pixels, numPixels, channelOffset1, channelOffset2);
+}
+
 void PNM::grayscale(int standard/*=709*/) {
+  InstrumentedScope scope("grayscale", (long long)width * height);
   if (numChannels == 1) {
     return;
   }
+  reduceToEightBit();
 
-  vector<unsigned char> newImgData;
-  newImgData.resize(width * height);
+  vector<unsigned char> newImgData = BufferPool::acquire(width * height);
 
-  int gray;
-  for (int i = 0; i < data.size(); i += numChannels) {
-    if (standard != 709 && standard != 601) {
-      newImgData[i / 3] = brightness(i);
-    }
-    else {
-      newImgData[i / 3] = luminence(i, standard);
-    }
-  }
+  const unsigned char* pixels = std::as_const(data).data();
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    grayscaleSpan(pixels + rowBegin * width * 3, &newImgData[rowBegin * width], (rowEnd - rowBegin) * width, standard);
+  });
 
   numChannels = 1;
-  data = newImgData;
+  data = std::move(newImgData);
 }
 
 void PNM::invertColor() {
-  for (int i = 0; i < data.size(); i += numChannels) {
-    data[i] = maxColor - data[i];
-
-    if (numChannels == 3) {
-      data[i + 1] = maxColor - data[i + 1];
-      data[i + 2] = maxColor - data[i + 2];
-    }
+  InstrumentedScope scope("invertColor", (long long)width * height);
+  int rowLength = width * numChannels;
+
+  if (bytesPerSample == 2) {
+    uint16_t* samples = reinterpret_cast<uint16_t*>(data.data());
+    ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+      for (int i = rowBegin * rowLength; i < rowEnd * rowLength; i++) {
+        samples[i] = maxColor - samples[i];
+      }
+    });
+    return;
   }
+
+  unsigned char* samples = data.data();
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    invertSpan(samples + rowBegin * rowLength, (rowEnd - rowBegin) * rowLength, maxColor);
+  });
 }
 
 void PNM::sepia() {
+  InstrumentedScope scope("sepia", (long long)width * height);
   if (numChannels == 1) {
     return;
   }
+  reduceToEightBit();
 
-  const int BRIGHTNESS = 2;
-
-  int gray;
-  for (int i = 0; i < data.size(); i += numChannels) {
-    gray = 0.2126 * data[i] + 0.7152 * data[i + 1] + 0.0722 * data[i + 2];
-
-    data[i] = gray * 0.439216 * BRIGHTNESS;
-    data[i + 1] = gray * 0.258824 * BRIGHTNESS;
-    data[i + 2] = gray * 0.078431 * BRIGHTNESS;
-  }
+  unsigned char* pixels = data.data();
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    sepiaSpan(pixels + rowBegin * width * 3, (rowEnd - rowBegin) * width);
+  });
 }
 
 void PNM::tint(float r, float g, float b, float brightness/*=1*/) {
+  InstrumentedScope scope("tint", (long long)width * height);
   if (numChannels == 1) {
     return;
   }
+  reduceToEightBit();
 
   r /= 255;
   g /= 255;
   b /= 255;
 
-  for (int i = 0; i < data.size(); i += numChannels) {
-    data[i] = data[i] * r * brightness;
-    data[i + 1] = data[i + 1] * g * brightness;
-    data[i + 2] = data[i + 2] * b * brightness;
-    pixelClip(i);
-  }
+  unsigned char* pixels = data.data();
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    tintSpan(pixels + rowBegin * width * 3, (rowEnd - rowBegin) * width, r, g, b, brightness);
+  });
 }
 
-void PNM::noise(string type, float noiseDensity) {
-  if (type == "salt" || type == "Salt") {
-    saltNoise(noiseDensity);
-  }
-  else if (type == "pepper" || type == "Pepper") {
-    pepperNoise(noiseDensity);
+void PNM::noise(string type, float amount) {
+  noise(type, amount, ((uint64_t)std::random_device()() << 32) | std::random_device()());
+}
+void PNM::noise(string type, float amount, uint64_t seed) {
+  InstrumentedScope scope("noise", (long long)width * height);
+  bool gaussian = type == "gaussian" || type == "Gaussian";
+  bool uniform = type == "uniform" || type == "Uniform";
+  bool salt = type == "salt" || type == "Salt";
+  bool pepper = type == "pepper" || type == "Pepper";
+  bool saltPepper = type == "saltPepper";
+  if (!gaussian && !uniform && !salt && !pepper && !saltPepper) {
+    return;
   }
+  reduceToEightBit();
+
+  const int BLOCK = CounterRNG::BLOCK;
+  int rowLength = width * numChannels;
+  unsigned char* samples = data.data();
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    for (int row = rowBegin; row < rowEnd; row++) {
+      // every row is its own stream, so the noise doesn't depend on how rows are split between threads
+      CounterRNG rng(seed, row);
+      unsigned char* rowSamples = samples + (size_t)row * rowLength;
+
+      if (!gaussian && !uniform) {
+        impulseNoiseRow(rowSamples, width, numChannels, rng, amount, salt || saltPepper, pepper || saltPepper);
+        continue;
+      }
+
+      // one value per sample
+      for (int block = 0; block * BLOCK < rowLength; block++) {
+        float noiseValues[BLOCK];
+        if (gaussian) {
+          rng.normal(block, noiseValues);
+        }
+        else {
+          rng.uniform(block, noiseValues);
+        }
+        int first = block * BLOCK;
+        addNoiseBlock(rowSamples + first, std::min(BLOCK, rowLength - first), noiseValues, amount);
+      }
+    }
+  });
 }
 
 // most basic image segmentation technique
 void PNM::threshold(int epsilon/*=100*/) {
+  InstrumentedScope scope("threshold", (long long)width * height);
+  // grayscale leaves 1-channel images alone, so 16-bit gray ones have to be reduced here
+  reduceToEightBit();
   grayscale();
 
-  for (int i = 0; i < data.size(); i += numChannels) {
-    if (data[i] > epsilon) {
-      data[i] = 255;
-    }
-    else {
-      data[i] = 0;
-    }
-  }
+  unsigned char* samples = data.data();
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    thresholdSpan(samples + rowBegin * width, (rowEnd - rowBegin) * width, epsilon);
+  });
 }
 
 void PNM::channelSwap(char channel1, char channel2) {
+  InstrumentedScope scope("channelSwap", (long long)width * height);
   if (numChannels == 1) {
     return;
   }
@@ -531,134 +1230,613 @@ void PNM::channelSwap(char channel1, char channel2) {
   int channelOffset1 =  channelToIndex[channel1];
   int channelOffset2 =  channelToIndex[channel2];
 
-  unsigned int temp;
-  for (int i = 0; i < data.size(); i += numChannels) {
-    temp = data[i + channelOffset1];
-    data[i + channelOffset1] = data[i  + channelOffset2];
-    data[i + channelOffset2] = temp;
+  if (bytesPerSample == 2) {
+    std::array<uint16_t, 3>* pixels = reinterpret_cast<std::array<uint16_t, 3>*>(data.data());
+    ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+      for (int i = rowBegin * width; i < rowEnd * width; i++) {
+        std::swap(pixels[i][channelOffset1], pixels[i][channelOffset2]);
+      }
+    });
+    return;
   }
+
+  unsigned char* pixels = data.data();
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    channelSwapSpan(pixels + rowBegin * width * 3, (rowEnd - rowBegin) * width, channelOffset1, channelOffset2);
+  });
 }
 
-void PNM::blur(string blurType, int radius) {
+void PNM::blur(string blurType, int radius, string borderMode/*="clamp"*/) {
+  InstrumentedScope scope("blur", (long long)width * height);
   if (blurType == "mean") {
-    data = meanBlur(radius);
+    data = meanBlur(radius, borderMode);
+  }
+  else if (blurType == "gaussian") {
+    reduceToEightBit();
+    data = gaussianBlur(radius, borderMode);
+  }
+  else if (blurType == "fastGaussian") {
+    reduceToEightBit();
+    data = fastGaussianBlur(radius, borderMode);
+  }
+  else if (blurType == "median") {
+    reduceToEightBit();
+    data = medianBlur(radius, borderMode);
   }
 }
 
 void PNM::chromaShift(int rshift, int gshift, int bshift, int threshold/*=0*/) {
+  InstrumentedScope scope("chromaShift", (long long)width * height);
   if (numChannels == 1) {
     return;
   }
-  vector<unsigned char> newImgData = data;
+  reduceToEightBit();
+  const unsigned char* pixels = std::as_const(data).data();
+  vector<unsigned char> newImgData = BufferPool::acquire(data.size());
+  std::memcpy(newImgData.data(), pixels, data.size());
+
+  // each destination byte has exactly one source pixel, so bands never write the same byte
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    for (int row = rowBegin; row < rowEnd; row++) {
+      for (int col = 0; col < width; col++) {
+        int pixIdx = (width * row + col) * numChannels;
+        if (threshold > 0 && brightness(pixIdx) < threshold) {
+          continue;
+        }
 
-  for (int row = 0; row < height; row++) {
-    for (int col = 0; col < width; col++) {
-      int pixIdx = (width * row + col) * numChannels;
-      if (threshold > 0 && brightness(pixIdx) < threshold) {
-        continue;
+        int rpos = pixIdx + rshift * numChannels;
+        int gpos = pixIdx + gshift * numChannels + 1;
+        int bpos = pixIdx + bshift * numChannels + 2;
+
+        if (rpos >= 0 && rpos < data.size()) {
+          newImgData[rpos] = pixels[pixIdx];
+        }
+        if (gpos >= 0 && gpos < data.size()) {
+          newImgData[gpos] = pixels[pixIdx + 1];
+        }
+        if (bpos >= 0 && bpos < data.size()) {
+          newImgData[bpos] = pixels[pixIdx + 2];
+        }
       }
+    }
+  });
 
-      int rpos = pixIdx + rshift * numChannels;
-      int gpos = pixIdx + gshift * numChannels + 1;
-      int bpos = pixIdx + bshift * numChannels + 2;
+  data = std::move(newImgData);
+}
 
-      if (rpos >= 0 && rpos < data.size()) {
-        newImgData[rpos] = data[pixIdx];
-      }
-      if (gpos >= 0 && gpos < data.size()) {
-        newImgData[gpos] = data[pixIdx + 1];
-      }
-      if (bpos >= 0 && bpos < data.size()) {
-        newImgData[bpos] = data[pixIdx + 2];
+void PNM::applyLUT(const LUT& lut) {
+  InstrumentedScope scope("applyLUT", (long long)width * height);
+  reduceToEightBit();
+
+  unsigned char* pixels = data.data();
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    lut.apply(pixels + rowBegin * width * numChannels, (rowEnd - rowBegin) * width, numChannels);
+  });
+}
+
+void PNM::gamma(double gamma) {
+  reduceToEightBit();
+  applyLUT(LUT::gamma(gamma, maxColor));
+}
+
+void PNM::brightnessContrast(int brightness, double contrast/*=1*/) {
+  reduceToEightBit();
+  applyLUT(LUT::brightnessContrast(brightness, contrast, maxColor));
+}
+
+void PNM::curves(const vector<std::array<int, 2>>& points) {
+  applyLUT(LUT::curves(points));
+}
+
+Histogram PNM::histogram(bool withHSL/*=false*/) const {
+  InstrumentedScope scope("histogram", (long long)width * height);
+  Histogram result;
+  std::mutex resultMutex;
+
+  const unsigned char* samples = data.data();
+  int rowLength = width * numChannels;
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    // a chunk of rows is counted as one span, so the per-call cost of merging bins is paid once
+    Histogram local;
+    size_t numSamples = (size_t)(rowEnd - rowBegin) * rowLength;
+    if (bytesPerSample == 1) {
+      local.accumulate(samples + (size_t)rowBegin * rowLength, (rowEnd - rowBegin) * width, numChannels, withHSL);
+    }
+    else {
+      const uint16_t* wideSamples = reinterpret_cast<const uint16_t*>(samples) + (size_t)rowBegin * rowLength;
+      vector<unsigned char> reduced = BufferPool::acquire(numSamples);
+      for (size_t i = 0; i < numSamples; i++) {
+        reduced[i] = (std::min<int>(wideSamples[i], maxColor) * 255 + maxColor / 2) / maxColor;
       }
+      local.accumulate(reduced.data(), (rowEnd - rowBegin) * width, numChannels, withHSL);
+      BufferPool::recycle(std::move(reduced));
     }
+
+    std::lock_guard<std::mutex> lock(resultMutex);
+    result.add(local);
+  });
+  return result;
+}
+
+int PNM::threshold(string method) {
+  InstrumentedScope scope("autoThreshold", (long long)width * height);
+  bool otsu = method == "otsu" || method == "Otsu";
+  bool triangle = method == "triangle" || method == "Triangle";
+  if (!otsu && !triangle) {
+    return -1;
   }
+  reduceToEightBit();
+  grayscale();
 
-  data = newImgData;
+  const Histogram::Bins& luminance = histogram().luminance;
+  int epsilon = otsu ? Histogram::otsuThreshold(luminance) : Histogram::triangleThreshold(luminance);
+  threshold(epsilon);
+  return epsilon;
 }
 
-// change to gaussian blur when added later
-void PNM::sharpen(double sharpness, int radius) {
-  vector<unsigned char> blurredImage = meanBlur(radius);
-  for (int i = 0; i < data.size(); i += numChannels) { 
-    data[i] = data[i] + sharpness * (data[i] - blurredImage[i]);
-    if (numChannels == 3) {
-      data[i + 1] = data[i + 1] + sharpness * (data[i + 1] - blurredImage[i + 1]);
-      data[i + 2] = data[i + 2] + sharpness * (data[i + 2] - blurredImage[i + 2]);
+void PNM::equalize(bool perChannel/*=false*/) {
+  InstrumentedScope scope("equalize", (long long)width * height);
+  reduceToEightBit();
+
+  Histogram counts = histogram();
+  std::array<unsigned char, Histogram::BINS> luminanceTable = Histogram::equalizeTable(counts.luminance);
+  LUT lut;
+  for (int channel = 0; channel < 3; channel++) {
+    std::array<unsigned char, Histogram::BINS> table = perChannel && numChannels == 3 ? Histogram::equalizeTable(counts.channels[channel]) : luminanceTable;
+    for (int value = 0; value < Histogram::BINS; value++) {
+      lut.at(channel, value) = table[value];
     }
   }
+  for (int value = 0; value < Histogram::BINS; value++) {
+    lut.at(LUT::GRAY, value) = luminanceTable[value];
+  }
+  applyLUT(lut);
 }
 
+void PNM::clahe(int tilesAcross/*=8*/, int tilesDown/*=8*/, double clipLimit/*=2*/) {
+  InstrumentedScope scope("clahe", (long long)width * height);
+  if (tilesAcross < 1 || tilesDown < 1 || width == 0 || height == 0) {
+    return;
+  }
+  reduceToEightBit();
+
+  // rounding the tile size up can leave fewer tiles than asked for
+  int tileWidth = (width + std::min(tilesAcross, width) - 1) / std::min(tilesAcross, width);
+  int tileHeight = (height + std::min(tilesDown, height) - 1) / std::min(tilesDown, height);
+  tilesAcross = (width + tileWidth - 1) / tileWidth;
+  tilesDown = (height + tileHeight - 1) / tileHeight;
+
+  unsigned char* samples = data.data();
+
+  // tiles are copied out into one span each so they're counted in one call
+  vector<std::array<unsigned char, Histogram::BINS>> tables(tilesAcross * tilesDown);
+  ThreadPool::shared().parallelFor(tilesAcross * tilesDown, [&](int tileBegin, int tileEnd) {
+    vector<unsigned char> tilePixels(tileWidth * tileHeight * numChannels);
+    for (int tile = tileBegin; tile < tileEnd; tile++) {
+      int top = tile / tilesAcross * tileHeight;
+      int left = tile % tilesAcross * tileWidth;
+      int tileRowLength = (std::min(left + tileWidth, width) - left) * numChannels;
+      int numRows = std::min(top + tileHeight, height) - top;
+      for (int row = 0; row < numRows; row++) {
+        memcpy(&tilePixels[row * tileRowLength], samples + ((size_t)(top + row) * width + left) * numChannels, tileRowLength);
+      }
 
-// image warps
+      Histogram counts;
+      counts.accumulate(tilePixels.data(), numRows * tileRowLength / numChannels, numChannels);
+      tables[tile] = Histogram::clippedEqualizeTable(counts.luminance, clipLimit);
+    }
+  });
+
+  // each tile's table belongs to its center, pixels between centers blend the two tables either side
+  // with 8-bit fixed point weights, past the outer centers they use the outer tables alone
+  struct Blend {
+    int first;
+    int second;
+    int weight;
+  };
+  auto blends = [](int length, int tileLength, int numTiles) {
+    vector<Blend> result(length);
+    for (int i = 0; i < length; i++) {
+      float position = (i + 0.5f) / tileLength - 0.5f;
+      int first = std::clamp((int)std::floor(position), 0, numTiles - 1);
+      int weight = std::clamp((int)((position - first) * 256 + 0.5f), 0, 256);
+      result[i] = {first, std::min(first + 1, numTiles - 1), weight};
+    }
+    return result;
+  };
+  vector<Blend> columns = blends(width, tileWidth, tilesAcross);
+  vector<Blend> rows = blends(height, tileHeight, tilesDown);
+
+  // a row's vertical blend is the same for every pixel in it, so the tables above and below are blended
+  // once per row and pixels only blend left and right
+  // rgb pixels look every channel up in the luminance tables so the channels move together
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    vector<uint16_t> rowTables(tilesAcross * Histogram::BINS);
+    for (int row = rowBegin; row < rowEnd; row++) {
+      const Blend& vertical = rows[row];
+      for (int tile = 0; tile < tilesAcross; tile++) {
+        const unsigned char* above = tables[vertical.first * tilesAcross + tile].data();
+        const unsigned char* below = tables[vertical.second * tilesAcross + tile].data();
+        uint16_t* blended = &rowTables[tile * Histogram::BINS];
+        for (int value = 0; value < Histogram::BINS; value++) {
+          blended[value] = above[value] * (256 - vertical.weight) + below[value] * vertical.weight;
+        }
+      }
 
+      unsigned char* pixels = samples + (size_t)row * width * numChannels;
+      for (int col = 0; col < width; col++) {
+        const Blend& horizontal = columns[col];
+        const uint16_t* left = &rowTables[horizontal.first * Histogram::BINS];
+        const uint16_t* right = &rowTables[horizontal.second * Histogram::BINS];
+        for (int channel = 0; channel < numChannels; channel++) {
+          int value = pixels[col * numChannels + channel];
+          pixels[col * numChannels + channel] = (left[value] * (256 - horizontal.weight) + right[value] * horizontal.weight + (1 << 15)) >> 16;
+        }
+      }
+    }
+  });
+}
 
-void PNM::verticalFlip() {
-  int temp[numChannels];
+void PNM::hueSaturation(double hueShift, double saturationScale/*=1*/) {
+  InstrumentedScope scope("hueSaturation", (long long)width * height);
+  if (numChannels == 1) {
+    return;
+  }
+  reduceToEightBit();
 
-  for (int row = 0; row < height / 2; row++) {
-    for (int col = 0; col < width; col++) {
-      int topIndex = (width * row + col) * numChannels;
-      int bottomIndex = ((height - row - 1) * width + col) * numChannels; 
+  // wraps the shift into 0-360 so shifted hues only ever need one wrap
+  float shift = std::fmod(hueShift, 360.0);
+  shift = shift < 0 ? shift + 360 : shift;
 
-      pixelSwap(topIndex, bottomIndex, data);
+  unsigned char* imgPixels = data.data();
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    vector<float> rowHSL(width * 3);
+    float* const planes[3] = {rowHSL.data(), rowHSL.data() + width, rowHSL.data() + 2 * width};
+
+    for (int row = rowBegin; row < rowEnd; row++) {
+      unsigned char* pixels = imgPixels + (size_t)width * row * 3;
+      ColorPlanes::convertFromPixels(ColorSpace::HSL, pixels, width, 3, maxColor, planes);
+      for (int col = 0; col < width; col++) {
+        float hue = planes[0][col] + shift;
+        planes[0][col] = hue >= 360 ? hue - 360 : hue;
+        planes[1][col] = std::min(planes[1][col] * (float)saturationScale, 1.0f);
+      }
+      ColorPlanes::convertToPixels(ColorSpace::HSL, planes, pixels, width, 3, maxColor);
     }
+  });
+}
+
+ColorPlanes PNM::toColorPlanes(ColorSpace space) {
+  InstrumentedScope scope("toColorPlanes", (long long)width * height);
+  reduceToEightBit();
+
+  ColorPlanes planes(space, width * height);
+  Instrumentation::recordAllocation((size_t)width * height * 3 * sizeof(float));
+  const unsigned char* pixels = std::as_const(data).data();
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    planes.fromPixels(pixels, rowBegin * width, (rowEnd - rowBegin) * width, numChannels, maxColor);
+  });
+  return planes;
+}
+
+void PNM::fromColorPlanes(const ColorPlanes& planes) {
+  InstrumentedScope scope("fromColorPlanes", (long long)width * height);
+  if (planes.numPixels != width * height) {
+    return;
   }
+  reduceToEightBit();
+
+  unsigned char* pixels = data.data();
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    planes.toPixels(pixels, rowBegin * width, (rowEnd - rowBegin) * width, numChannels, maxColor);
+  });
 }
-void PNM::verticalReflection(char direction/*='t'*/) {
-  for (int row = 0; row < height / 2; row++) {
-    for (int col = 0; col < width; col++) {
 
-      if (direction == 't' || direction == 'T') { // 'T' is for top
-        for (int i = 0; i < numChannels; i++) {
-          data[((height - row - 1) * width + col) * numChannels + i] = data[(width * row + col) * numChannels + i]; 
+void PNM::sharpen(double sharpness, int radius) {
+  InstrumentedScope scope("sharpen", (long long)width * height);
+  reduceToEightBit();
+  vector<unsigned char> blurredImage = gaussianBlur(radius);
+  int rowLength = width * numChannels;
+  unsigned char* samples = data.data();
+
+  ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+    for (int i = rowBegin * rowLength; i < rowEnd * rowLength; i++) {
+      double sharpened = samples[i] + sharpness * (samples[i] - blurredImage[i]);
+      samples[i] = std::clamp(sharpened, 0.0, 255.0);
+    }
+  });
+  BufferPool::recycle(std::move(blurredImage));
+}
+
+// direct and separable convolution is fixed point, samples are widened to 16 bits and every output sample
+// is a 32-bit sum of 16-bit products, done BLOCK samples of a row at a time so the inner loops have fixed
+// trip counts
+// rank-1 kernels run a horizontal pass into 16-bit rows, then a vertical pass over those
+// large kernels go through the fft a tile at a time instead, see convolveFFT
+void PNM::convolve(const ConvolutionKernel& kernel, string borderMode/*="clamp"*/, string method/*="auto"*/) {
+  InstrumentedScope scope("convolve", (long long)width * height);
+  reduceToEightBit();
+
+  ConvolutionPlan plan = ConvolutionPlan::choose(kernel, width, height, method);
+  if (plan.method == ConvolutionPlan::FFT) {
+    data = convolveFFT(kernel, borderMode, plan.tileWidth, plan.tileHeight);
+    return;
+  }
+
+  const int BLOCK = 64;
+  int radiusX = kernel.getWidth() / 2;
+  int radiusY = kernel.getHeight() / 2;
+  int rowLength = width * numChannels;
+  int blockedLength = (rowLength + BLOCK - 1) / BLOCK * BLOCK;
+  // a widened row also holds the border columns either side, and past the end whatever the last block reads
+  int widenedLength = blockedLength + 2 * radiusX * numChannels;
+
+  vector<int> colIndices = borderIndices(width, radiusX, borderMode);
+  vector<int> rowIndices = borderIndices(height, radiusY, borderMode);
+  int bias = std::lround(kernel.getBias());
+
+  const unsigned char* pixels = std::as_const(data).data();
+  auto widenRow = [&](int row, int16_t* dst) {
+    const unsigned char* src = pixels + (size_t)row * rowLength;
+    for (int i = 0; i < colIndices.size(); i++) {
+      for (int channel = 0; channel < numChannels; channel++) {
+        dst[i * numChannels + channel] = colIndices[i] >= 0 ? src[colIndices[i] * numChannels + channel] : 0;
+      }
+    }
+    std::fill(dst + colIndices.size() * numChannels, dst + widenedLength, 0);
+  };
+  // sums are rounded off at shift fraction bits, the bias added and the result saturated to 0-255
+  auto storeBlock = [&](const int32_t (&sums)[BLOCK], int shift, unsigned char* dst, int count) {
+    int32_t half = shift > 0 ? 1 << (shift - 1) : 0;
+    unsigned char block[BLOCK];
+    for (int i = 0; i < BLOCK; i++) {
+      block[i] = std::clamp(((sums[i] + half) >> shift) + bias, 0, 255);
+    }
+    memcpy(dst, block, count);
+  };
+
+  vector<unsigned char> newImgData = BufferPool::acquire(data.size());
+  vector<double> columnWeights, rowWeights;
+  if (plan.method == ConvolutionPlan::SEPARABLE && kernel.separate(columnWeights, rowWeights)) {
+    FixedPointWeights horizontal = FixedPointWeights::quantize(rowWeights, 255);
+    // the horizontal sums are shifted down just far enough to fit 16 bits
+    int keptShift = 0;
+    while ((horizontal.bound(255) >> keptShift) > INT16_MAX) {
+      keptShift++;
+    }
+    FixedPointWeights vertical = FixedPointWeights::quantize(columnWeights, INT16_MAX);
+    int finalShift = horizontal.shift - keptShift + vertical.shift;
+
+    vector<unsigned char> horizontalBuffer = BufferPool::acquire((size_t)height * blockedLength * sizeof(int16_t));
+    int16_t* rows = reinterpret_cast<int16_t*>(horizontalBuffer.data());
+    ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+      vector<int16_t> widened(widenedLength);
+      int32_t half = keptShift > 0 ? 1 << (keptShift - 1) : 0;
+      for (int row = rowBegin; row < rowEnd; row++) {
+        widenRow(row, widened.data());
+        int16_t* dst = &rows[(size_t)row * blockedLength];
+        for (int start = 0; start < blockedLength; start += BLOCK) {
+          int32_t sums[BLOCK] = {};
+          for (int k = 0; k < kernel.getWidth(); k++) {
+            const int16_t* src = &widened[start + k * numChannels];
+            int weight = horizontal.weights[k];
+            for (int i = 0; i < BLOCK; i++) {
+              sums[i] += src[i] * weight;
+            }
+          }
+          for (int i = 0; i < BLOCK; i++) {
+            dst[start + i] = (sums[i] + half) >> keptShift;
+          }
         }
       }
-      else if (direction == 'b' || direction == 'B') { // 'B' is for bottom
-        for (int i = 0; i < numChannels; i++) {
-          data[(width * row + col) * numChannels + i] = data[((height - row - 1) * width + col) * numChannels + i];
+    });
+
+    ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+      for (int row = rowBegin; row < rowEnd; row++) {
+        unsigned char* dst = &newImgData[(size_t)row * rowLength];
+        for (int start = 0; start < blockedLength; start += BLOCK) {
+          int32_t sums[BLOCK] = {};
+          for (int k = 0; k < kernel.getHeight(); k++) {
+            if (rowIndices[row + k] < 0) {
+              continue;
+            }
+            const int16_t* src = &rows[(size_t)rowIndices[row + k] * blockedLength + start];
+            int weight = vertical.weights[k];
+            for (int i = 0; i < BLOCK; i++) {
+              sums[i] += src[i] * weight;
+            }
+          }
+          storeBlock(sums, finalShift, dst + start, std::min(BLOCK, rowLength - start));
         }
       }
-    }
+    });
+    BufferPool::recycle(std::move(horizontalBuffer));
   }
+  else {
+    FixedPointWeights weights = FixedPointWeights::quantize(kernel.getWeights(), 255);
+
+    // every source row is widened once, each output row then reads kernel height of them
+    vector<unsigned char> widenedBuffer = BufferPool::acquire((size_t)height * widenedLength * sizeof(int16_t));
+    int16_t* widened = reinterpret_cast<int16_t*>(widenedBuffer.data());
+    ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+      for (int row = rowBegin; row < rowEnd; row++) {
+        widenRow(row, &widened[(size_t)row * widenedLength]);
+      }
+    });
+
+    ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+      for (int row = rowBegin; row < rowEnd; row++) {
+        unsigned char* dst = &newImgData[(size_t)row * rowLength];
+        for (int start = 0; start < blockedLength; start += BLOCK) {
+          int32_t sums[BLOCK] = {};
+          for (int ky = 0; ky < kernel.getHeight(); ky++) {
+            if (rowIndices[row + ky] < 0) {
+              continue;
+            }
+            const int16_t* srcRow = &widened[(size_t)rowIndices[row + ky] * widenedLength + start];
+            for (int kx = 0; kx < kernel.getWidth(); kx++) {
+              const int16_t* src = srcRow + kx * numChannels;
+              int weight = weights.weights[ky * kernel.getWidth() + kx];
+              if (weight == 0) {
+                continue;
+              }
+              for (int i = 0; i < BLOCK; i++) {
+                sums[i] += src[i] * weight;
+              }
+            }
+          }
+          storeBlock(sums, weights.shift, dst + start, std::min(BLOCK, rowLength - start));
+        }
+      }
+    });
+    BufferPool::recycle(std::move(widenedBuffer));
+  }
+
+  data = std::move(newImgData);
 }
 
-void PNM::horizontalFlip() {
-  int temp[numChannels];
+// overlap-save, each tile of the padded image is transformed, multiplied by the kernel's spectrum and
+// transformed back, and only the outputs the circular wrap-around didn't reach are kept
+// tiles are independent, so they're shared out between threads and each only holds its own buffers
+vector<unsigned char> PNM::convolveFFT(const ConvolutionKernel& kernel, string borderMode, int tileWidth, int tileHeight) {
+  int kernelWidth = kernel.getWidth();
+  int kernelHeight = kernel.getHeight();
+  int outputWidth = tileWidth - kernelWidth + 1;
+  int outputHeight = tileHeight - kernelHeight + 1;
+  int tilesAcross = (width + outputWidth - 1) / outputWidth;
+  int tilesDown = (height + outputHeight - 1) / outputHeight;
+
+  vector<int> colIndices = borderIndices(width, kernelWidth / 2, borderMode);
+  vector<int> rowIndices = borderIndices(height, kernelHeight / 2, borderMode);
+  float bias = kernel.getBias();
+
+  FFT2D fft(tileWidth, tileHeight);
+  int spectrumSize = fft.getSpectrumWidth() * tileHeight;
+
+  // flipped and wrapped so the kernel's last weight sits at the origin, then output (y, x) of a tile
+  // lands at (y + kernelHeight - 1, x + kernelWidth - 1)
+  vector<std::complex<float>> kernelSpectrum(spectrumSize);
+  {
+    vector<float> kernelTile(tileWidth * tileHeight, 0);
+    for (int row = 0; row < kernelHeight; row++) {
+      for (int col = 0; col < kernelWidth; col++) {
+        kernelTile[(kernelHeight - 1 - row) * tileWidth + kernelWidth - 1 - col] = kernel.at(row, col);
+      }
+    }
+    fft.forward(kernelTile.data(), kernelSpectrum.data());
+  }
+
+  const unsigned char* pixels = std::as_const(data).data();
+  vector<unsigned char> newImgData = BufferPool::acquire(data.size());
+  ThreadPool::shared().parallelFor(tilesAcross * tilesDown, [&](int tileBegin, int tileEnd) {
+    vector<float> tile(tileWidth * tileHeight);
+    vector<std::complex<float>> spectrum(spectrumSize);
+    for (int tileIndex = tileBegin; tileIndex < tileEnd; tileIndex++) {
+      int top = tileIndex / tilesAcross * outputHeight;
+      int left = tileIndex % tilesAcross * outputWidth;
+      int numRows = std::min(outputHeight, height - top);
+      int numCols = std::min(outputWidth, width - left);
+
+      for (int channel = 0; channel < numChannels; channel++) {
+        // padded rows and columns past the image only feed outputs that are thrown away
+        for (int row = 0; row < tileHeight; row++) {
+          int srcRow = top + row < rowIndices.size() ? rowIndices[top + row] : -1;
+          float* dst = &tile[row * tileWidth];
+          for (int col = 0; col < tileWidth; col++) {
+            int srcCol = left + col < colIndices.size() ? colIndices[left + col] : -1;
+            dst[col] = srcRow >= 0 && srcCol >= 0 ? pixels[((size_t)srcRow * width + srcCol) * numChannels + channel] : 0;
+          }
+        }
+
+        fft.forward(tile.data(), spectrum.data());
+        float* values = reinterpret_cast<float*>(spectrum.data());
+        const float* weights = reinterpret_cast<const float*>(kernelSpectrum.data());
+        for (int i = 0; i < spectrumSize; i++) {
+          float re = values[2 * i] * weights[2 * i] - values[2 * i + 1] * weights[2 * i + 1];
+          float im = values[2 * i] * weights[2 * i + 1] + values[2 * i + 1] * weights[2 * i];
+          values[2 * i] = re;
+          values[2 * i + 1] = im;
+        }
+        fft.inverse(spectrum.data(), tile.data());
+
+        for (int row = 0; row < numRows; row++) {
+          const float* src = &tile[(row + kernelHeight - 1) * tileWidth + kernelWidth - 1];
+          unsigned char* dst = &newImgData[((size_t)(top + row) * width + left) * numChannels + channel];
+          for (int col = 0; col < numCols; col++) {
+            dst[col * numChannels] = std::clamp(src[col] + bias, 0.0f, 255.0f) + 0.5f;
+          }
+        }
+      }
+    }
+  });
+  return newImgData;
+}
+
+
+// image warps
+
+
+void PNM::verticalFlip() {
+  InstrumentedScope scope("verticalFlip", (long long)width * height);
+  orthogonalTransform(false, false, true);
+}
+void PNM::verticalReflection(char direction/*='t'*/) {
+  InstrumentedScope scope("verticalReflection", (long long)width * height);
+
+  dispatchPixelType([&]<typename Pixel>(Pixel*) {
+    Pixel* pixels = reinterpret_cast<Pixel*>(data.data());
 
-  for (int row = 0; row < height; row++) {
-    for (int col = 0; col < width / 2; col++) {
-      int leftIndex = (width * row + col) * numChannels;
-      int rightIndex = (((width * row) + (width - 1)) - col) * numChannels; 
+    for (int row = 0; row < height / 2; row++) {
+      for (int col = 0; col < width; col++) {
+        int topIndex = width * row + col;
+        int bottomIndex = (height - row - 1) * width + col;
 
-      pixelSwap(leftIndex, rightIndex, data);
+        if (direction == 't' || direction == 'T') { // 'T' is for top
+          pixels[bottomIndex] = pixels[topIndex];
+        }
+        else if (direction == 'b' || direction == 'B') { // 'B' is for bottom
+          pixels[topIndex] = pixels[bottomIndex];
+        }
+      }
     }
-  }
+  });
+}
+
+void PNM::horizontalFlip() {
+  InstrumentedScope scope("horizontalFlip", (long long)width * height);
+  orthogonalTransform(false, true, false);
 }
 void PNM::horizontalReflection(char direction/*='l'*/) {
-  for (int row = 0; row < height; row++) {
-    for (int col = 0; col < width / 2; col++) {
+  InstrumentedScope scope("horizontalReflection", (long long)width * height);
 
-      if (direction == 'l' || direction == 'L') { // 'L' is for left
-        for (int i = 0; i < numChannels; i++) {
-          data[(((width * row) + (width - 1)) - col) * numChannels + i] = data[(width * row + col) * numChannels + i]; 
+  dispatchPixelType([&]<typename Pixel>(Pixel*) {
+    Pixel* pixels = reinterpret_cast<Pixel*>(data.data());
+
+    for (int row = 0; row < height; row++) {
+      for (int col = 0; col < width / 2; col++) {
+        int leftIndex = width * row + col;
+        int rightIndex = ((width * row) + (width - 1)) - col;
+
+        if (direction == 'l' || direction == 'L') { // 'L' is for left
+          pixels[rightIndex] = pixels[leftIndex];
         }
-      }
-      else if (direction == 'r' || direction == 'R') { // 'R' is for right
-        for (int i = 0; i < numChannels; i++) {
-          data[(width * row + col) * numChannels + i] = data[(((width * row) + (width - 1)) - col) * numChannels + i];
+        else if (direction == 'r' || direction == 'R') { // 'R' is for right
+          pixels[leftIndex] = pixels[rightIndex];
         }
       }
     }
-  }
+  });
 }
 
-vector<PNM> PNM::combinedReflection() {
-  vector<PNM> reflectedImages;
-  
-  PNM temp;
+vector<PNM> PNM::combinedReflection() const {
+  InstrumentedScope scope("combinedReflection", (long long)width * height);
+  vector<PNM> reflectedImages(4);
+
   for (int i = 0; i < 4; i++) {
+    // starts out sharing this image's pixels, the first reflection copies them
+    PNM& temp = reflectedImages[i];
     temp.setMembers(filepath, width, height, maxColor, numChannels, data);
+    Instrumentation::recordAllocation(data.size());
 
     switch(i) {
       case 0:
@@ -681,138 +1859,327 @@ vector<PNM> PNM::combinedReflection() {
         temp.horizontalReflection('r');
         break;
     }
-    reflectedImages.push_back(temp);
   }
   return reflectedImages;
 }
 
 void PNM::rectCrop(std::array<int, 2> upperLeft, int newWidth, int newHeight) {
-  if (newWidth > width || newHeight > height) {
+  InstrumentedScope scope("rectCrop", (long long)width * height);
+  if (upperLeft[0] < 0 || upperLeft[1] < 0 || newWidth <= 0 || newHeight <= 0 || upperLeft[0] + newHeight > height || upperLeft[1] + newWidth > width) {
     return;
   }
 
-  vector<unsigned char> newImgData(newWidth * newHeight * numChannels);
-
-  for (int row = 0; row < newHeight; row++) {
-    for (int col = 0; col < newWidth; col++) {
-      int oldIndex = ((upperLeft[0] + row) * width + (upperLeft[1] + col)) * numChannels;
-      int newIndex = (newWidth * row + col) * numChannels;
+  size_t pixelSize = numChannels * bytesPerSample;
+  size_t stride = width * pixelSize;
+  size_t rowSize = newWidth * pixelSize;
+  const unsigned char* source = std::as_const(data).data() + upperLeft[0] * stride + upperLeft[1] * pixelSize;
 
-      newImgData[newIndex] = data[oldIndex];
-      if (numChannels == 3) {
-        newImgData[newIndex + 1] = data[oldIndex + 1];
-        newImgData[newIndex + 2] = data[oldIndex + 2];
-      }
+  // writing to shared or mapped pixels would copy all of them first, so only the crop is copied
+  if (data.isShared() || data.isMapped()) {
+    vector<unsigned char> newImgData = BufferPool::acquire(rowSize * newHeight);
+    for (int row = 0; row < newHeight; row++) {
+      std::memcpy(&newImgData[row * rowSize], source + row * stride, rowSize);
     }
+    data = std::move(newImgData);
+  }
+  else {
+    // rows only ever move toward the start of the buffer, so they're packed in place
+    unsigned char* pixels = data.data();
+    for (int row = 0; row < newHeight; row++) {
+      std::memmove(pixels + row * rowSize, source + row * stride, rowSize);
+    }
+    data.resize(rowSize * newHeight);
   }
 
   width = newWidth;
   height = newHeight;
-  data = newImgData;
 }
 
-void PNM::rotate(double theta, bool degrees/*=true*/) {
-  if (degrees) { // converts to radians
-    theta *= std::numbers::pi / 180;
+void PNM::warp(const AffineTransform& transform, string interpolation/*="bilinear"*/) {
+  InstrumentedScope scope("warp", (long long)width * height);
+
+  // signed permutation matrices, quarter turns, flips and transposes, only move pixels around
+  auto near = [](double value, double target) { return std::abs(value - target) < 1e-9; };
+  if (near(transform.b, 0) && near(transform.d, 0) && near(std::abs(transform.a), 1) && near(std::abs(transform.e), 1)) {
+    orthogonalTransform(false, transform.a < 0, transform.e < 0);
+    return;
+  }
+  if (near(transform.a, 0) && near(transform.e, 0) && near(std::abs(transform.b), 1) && near(std::abs(transform.d), 1)) {
+    orthogonalTransform(true, transform.b < 0, transform.d < 0);
+    return;
   }
-  vector<int> tempRotatedCoordinates(2);
 
-  int oldWidth = width;
-  int oldHeight = height;
+  // bounding box of the transformed corners
+  double minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+  for (std::array<double, 2> corner : {std::array<double, 2>{0, 0}, {(double)width, 0}, {0, (double)height}, {(double)width, (double)height}}) {
+    std::array<double, 2> mapped = transform.apply(corner[0], corner[1]);
+    minX = std::min(minX, mapped[0]);
+    minY = std::min(minY, mapped[1]);
+    maxX = std::max(maxX, mapped[0]);
+    maxY = std::max(maxY, mapped[1]);
+  }
 
-  // computes rotated image height and width
-  width = std::abs(oldWidth * std::cos(theta)) + std::abs(oldHeight * std::sin(theta));
-  height = std::abs(oldWidth * std::sin(theta)) + std::abs(oldHeight * std::cos(theta)) + 1; // off-by-one error without +1, proper fix should be done
+  // corners a rounding error past a pixel edge don't add a row or column
+  int newWidth = std::max((int)std::ceil(maxX - minX - 1e-6), 1);
+  int newHeight = std::max((int)std::ceil(maxY - minY - 1e-6), 1);
 
-  vector<unsigned char> newImgData(width * height * numChannels);
+  warpPixels(transform.then(AffineTransform::translation(-minX, -minY)), newWidth, newHeight, interpolation);
+}
+void PNM::warp(const AffineTransform& transform, int newWidth, int newHeight, string interpolation/*="bilinear"*/) {
+  InstrumentedScope scope("warp", (long long)width * height);
+  warpPixels(transform, newWidth, newHeight, interpolation);
+}
 
-  // computes minimum rotated coordinates to avoid out-of-bounds indicies
-  vector<int> rowBoundsIndices(4);
-  vector<int> colBoundsIndices(4);
+void PNM::rotate(double theta, bool degrees/*=true*/, string interpolation/*="neighbor"*/) {
+  InstrumentedScope scope("rotate", (long long)width * height);
+  warp(AffineTransform::rotation(theta, degrees), interpolation);
+}
 
-  tempRotatedCoordinates = rotateCoordinates(0, 0, theta);
-  rowBoundsIndices[0] = tempRotatedCoordinates[0];
-  colBoundsIndices[0] = tempRotatedCoordinates[1];
+void PNM::shear(double shearX, double shearY, string interpolation/*="bilinear"*/) {
+  InstrumentedScope scope("shear", (long long)width * height);
+  warp(AffineTransform::shear(shearX, shearY), interpolation);
+}
 
-  tempRotatedCoordinates = rotateCoordinates(0, oldWidth, theta);
-  rowBoundsIndices[1] = tempRotatedCoordinates[0];
-  colBoundsIndices[1] = tempRotatedCoordinates[1];
+void PNM::rotate90(int quarterTurns/*=1*/) {
+  InstrumentedScope scope("rotate90", (long long)width * height);
+  switch (((quarterTurns % 4) + 4) % 4) {
+    case 1:
+      orthogonalTransform(true, true, false);
+      break;
+    case 2:
+      orthogonalTransform(false, true, true);
+      break;
+    case 3:
+      orthogonalTransform(true, false, true);
+      break;
+  }
+}
 
-  tempRotatedCoordinates = rotateCoordinates(oldHeight, oldWidth, theta);
-  rowBoundsIndices[2] = tempRotatedCoordinates[0];
-  colBoundsIndices[2] = tempRotatedCoordinates[1];
+void PNM::transpose() {
+  InstrumentedScope scope("transpose", (long long)width * height);
+  orthogonalTransform(true, false, false);
+}
 
-  tempRotatedCoordinates = rotateCoordinates(oldHeight, 0, theta);
-  rowBoundsIndices[3] = tempRotatedCoordinates[0];
-  colBoundsIndices[3] = tempRotatedCoordinates[1];
+void PNM::orient(int orientation) {
+  InstrumentedScope scope("orient", (long long)width * height);
+  switch (orientation) {
+    case 2: // mirrored
+      orthogonalTransform(false, true, false);
+      break;
+    case 3: // upside down
+      orthogonalTransform(false, true, true);
+      break;
+    case 4: // mirrored upside down
+      orthogonalTransform(false, false, true);
+      break;
+    case 5: // transposed
+      orthogonalTransform(true, false, false);
+      break;
+    case 6: // needs a quarter turn clockwise
+      orthogonalTransform(true, true, false);
+      break;
+    case 7: // transverse
+      orthogonalTransform(true, true, true);
+      break;
+    case 8: // needs a quarter turn counterclockwise
+      orthogonalTransform(true, false, true);
+      break;
+  }
+}
 
-  auto min1 = std::min_element(rowBoundsIndices.begin(), rowBoundsIndices.end());
-  int minRow = std::abs(*min1);
+void PNM::scale(double widthScale, double heightScale, string interpolation/*="neighbor"*/) {
+  InstrumentedScope scope("scale", (long long)width * height);
+  if (widthScale <= 0 || heightScale <= 0) {
+    return;
+  }
 
-  auto min2 = std::min_element(colBoundsIndices.begin(), colBoundsIndices.end());
-  int minCol = std::abs(*min2);
+  int newWidth = std::max((int)std::round(width * widthScale), 1);
+  int newHeight = std::max((int)std::round(height * heightScale), 1);
+  if (newWidth == width && newHeight == height) {
+    return;
+  }
 
-  // computes rotation
-  for (int row = 0; row < oldHeight; row++) {
-    for (int col = 0; col < oldWidth; col++) {
-      int oldIndex = (oldWidth * row + col) * numChannels;
-      tempRotatedCoordinates = rotateCoordinates(row, col, theta);
+  ResampleWeights columnWeights = ResampleWeights::compute(width, newWidth, interpolation);
+  ResampleWeights rowWeights = ResampleWeights::compute(height, newHeight, interpolation);
+  const int ROUND = 1 << (ResampleWeights::SHIFT - 1);
 
-      int newRowIndex = tempRotatedCoordinates[0] + minRow;
-      int newColIndex = tempRotatedCoordinates[1] + minCol;
-      int newIndex = (width * newRowIndex + newColIndex) * numChannels;
+  vector<unsigned char> newImgData = BufferPool::acquire((size_t)newWidth * newHeight * numChannels * bytesPerSample);
 
-      newImgData[newIndex] = data[oldIndex];
+  dispatchPixelType([&]<typename Pixel>(Pixel*) {
+    using Sample = typename Pixel::value_type;
+    using Sum = std::conditional_t<sizeof(Sample) == 1, int, int64_t>;
+    constexpr int CHANNELS = std::tuple_size_v<Pixel>;
+    const Pixel* pixels = reinterpret_cast<const Pixel*>(std::as_const(data).data());
+    Pixel* newPixels = reinterpret_cast<Pixel*>(newImgData.data());
 
-      if (numChannels == 3) {
-        newImgData[newIndex + 1] = data[oldIndex + 1];
-        newImgData[newIndex + 2] = data[oldIndex + 2];
-      }
+    // one tap per output pixel on both axes, e.g. neighbor, is a plain gather
+    if (columnWeights.maxTaps == 1 && rowWeights.maxTaps == 1) {
+      ThreadPool::shared().parallelFor(newHeight, [&](int rowBegin, int rowEnd) {
+        for (int row = rowBegin; row < rowEnd; row++) {
+          const Pixel* src = &pixels[(size_t)rowWeights.first[row] * width];
+          Pixel* dst = &newPixels[(size_t)row * newWidth];
+          for (int col = 0; col < newWidth; col++) {
+            dst[col] = src[columnWeights.first[col]];
+          }
+        }
+      });
+      return;
     }
-  }
 
-  data = newImgData;
-}
-
-void PNM::testSort() {
-  for (int row = 0; row < height; row++) {
-    for (int col = 0; col < width; col++) {
-      int minIndex = (width * row + col) * numChannels;
+    // horizontal pass, straight into the output if the height doesn't change
+    vector<unsigned char> resizedRows;
+    const Pixel* rows = pixels;
+    if (newWidth != width) {
+      Pixel* dstRows = newPixels;
+      if (newHeight != height) {
+        resizedRows = BufferPool::acquire((size_t)newWidth * height * sizeof(Pixel));
+        dstRows = reinterpret_cast<Pixel*>(resizedRows.data());
+      }
 
-      for (int k = (width * row + col) * numChannels; k < (height * width) * numChannels; k += numChannels) {
-        if (data[minIndex] > data[k]) {
-          pixelSwap(minIndex, k, data);
+      ThreadPool::shared().parallelFor(height, [&](int rowBegin, int rowEnd) {
+        for (int row = rowBegin; row < rowEnd; row++) {
+          const Pixel* src = &pixels[(size_t)row * width];
+          Pixel* dst = &dstRows[(size_t)row * newWidth];
+
+          for (int col = 0; col < newWidth; col++) {
+            const Pixel* taps = &src[columnWeights.first[col]];
+            const int* weights = &columnWeights.weights[col * columnWeights.maxTaps];
+
+            Sum sum[CHANNELS] = {};
+            for (int k = 0; k < columnWeights.count[col]; k++) {
+              for (int channel = 0; channel < CHANNELS; channel++) {
+                sum[channel] += taps[k][channel] * weights[k];
+              }
+            }
+            for (int channel = 0; channel < CHANNELS; channel++) {
+              dst[col][channel] = std::clamp<Sum>((sum[channel] + ROUND) >> ResampleWeights::SHIFT, 0, maxColor);
+            }
+          }
         }
-      }
+      });
+      rows = dstRows;
     }
-  }
-}
 
-void PNM::scale(double widthScale, double heightScale, string interpolation/*="neighbor"*/) {
-  vector<unsigned char> newImgData(width * widthScale * height * heightScale * numChannels);
-  const double ROUND = 0.5;
+    // vertical pass, weighted sums of whole rows so the inner loop runs along contiguous samples
+    if (newHeight != height) {
+      int rowLength = newWidth * CHANNELS;
 
-  for (int row = 0; row < height * heightScale; row++) {
-    for (int col = 0; col < width * widthScale; col++) {
-      int newIndex = (width * widthScale * row + col) * numChannels;
+      ThreadPool::shared().parallelFor(newHeight, [&](int rowBegin, int rowEnd) {
+        vector<Sum> sums(rowLength);
 
-      int oldRowIndex = (row / heightScale) + ROUND;
-      int oldColIndex = (col / widthScale) + ROUND;
-      int oldIndex = (width * oldRowIndex + oldColIndex) * numChannels;
+        for (int row = rowBegin; row < rowEnd; row++) {
+          std::fill(sums.begin(), sums.end(), 0);
 
-      newImgData[newIndex] = data[oldIndex];
-      if (numChannels == 3) {
-        newImgData[newIndex + 1] = data[oldIndex + 1];
-        newImgData[newIndex + 2] = data[oldIndex + 2];
-      }
+          for (int k = 0; k < rowWeights.count[row]; k++) {
+            const Sample* src = reinterpret_cast<const Sample*>(&rows[(size_t)(rowWeights.first[row] + k) * newWidth]);
+            int weight = rowWeights.weights[row * rowWeights.maxTaps + k];
+            for (int i = 0; i < rowLength; i++) {
+              sums[i] += src[i] * weight;
+            }
+          }
+
+          Sample* dst = reinterpret_cast<Sample*>(&newPixels[(size_t)row * newWidth]);
+          for (int i = 0; i < rowLength; i++) {
+            dst[i] = std::clamp<Sum>((sums[i] + ROUND) >> ResampleWeights::SHIFT, 0, maxColor);
+          }
+        }
+      });
     }
-  }
+    BufferPool::recycle(std::move(resizedRows));
+  });
 
-  data = newImgData;
-  width *= widthScale;
-  height *= heightScale;
+  width = newWidth;
+  height = newHeight;
+  data = std::move(newImgData);
 }
 
-void PNM::pixelSort(char direction/*='l'*/, string sortCriteria, bool stable /*=false*/) {
-  quickSort(data, 0, width * height * numChannels - 3);
+void PNM::pixelSort(char direction/*='l'*/, string sortCriteria, bool stable /*=false*/, int spanLow/*=0*/, int spanHigh/*=360*/) {
+  InstrumentedScope scope("pixelSort", (long long)width * height);
+  bool alongRows = direction == 'l' || direction == 'r';
+  bool descending = direction == 'l' || direction == 'u';
+  if (!alongRows && direction != 'u' && direction != 'd') {
+    return;
+  }
+
+  reduceToEightBit();
+  int numKeys;
+  vector<unsigned short> keys = sortKeys(sortCriteria, numKeys);
+  if (numKeys == 0) {
+    return;
+  }
+
+  // a line is a row or a column, sorted on its own so lines run in parallel
+  int numLines = alongRows ? height : width;
+  int lineLength = alongRows ? width : height;
+  size_t lineStride = alongRows ? width : 1;
+  size_t pixelStride = alongRows ? 1 : width;
+  const int SHORT_SPAN = 32;
+
+  dispatchPixelType([&]<typename Pixel>(Pixel*) {
+    Pixel* pixels = reinterpret_cast<Pixel*>(data.data());
+
+    ThreadPool::shared().parallelFor(numLines, [&](int lineBegin, int lineEnd) {
+      vector<Pixel> linePixels(lineLength);
+      vector<Pixel> sorted(lineLength);
+      vector<unsigned short> lineKeys(lineLength);
+      vector<int> starts(numKeys + 1);
+
+      for (int line = lineBegin; line < lineEnd; line++) {
+        // gathers columns into a contiguous line too, descending lines sort on flipped keys to stay stable
+        for (int i = 0; i < lineLength; i++) {
+          size_t index = line * lineStride + i * pixelStride;
+          linePixels[i] = pixels[index];
+          lineKeys[i] = keys[index];
+        }
+        auto inSpan = [&](int i) { return lineKeys[i] >= spanLow && lineKeys[i] <= spanHigh; };
+        auto sortKey = [&](unsigned short key) { return descending ? numKeys - 1 - key : key; };
+
+        int spanBegin = 0;
+        while (spanBegin < lineLength) {
+          if (!inSpan(spanBegin)) {
+            spanBegin++;
+            continue;
+          }
+          int spanEnd = spanBegin + 1;
+          while (spanEnd < lineLength && inSpan(spanEnd)) {
+            spanEnd++;
+          }
+
+          if (spanEnd - spanBegin < SHORT_SPAN) {
+            // insertion sort, clearing numKeys counters would cost more than the span itself
+            for (int i = spanBegin + 1; i < spanEnd; i++) {
+              Pixel pixel = linePixels[i];
+              unsigned short key = lineKeys[i];
+              int j = i;
+              for (; j > spanBegin && sortKey(lineKeys[j - 1]) > sortKey(key); j--) {
+                linePixels[j] = linePixels[j - 1];
+                lineKeys[j] = lineKeys[j - 1];
+              }
+              linePixels[j] = pixel;
+              lineKeys[j] = key;
+            }
+          }
+          else {
+            // counting sort, starts[key] becomes the first output slot of that key
+            std::fill(starts.begin(), starts.end(), 0);
+            for (int i = spanBegin; i < spanEnd; i++) {
+              starts[sortKey(lineKeys[i]) + 1]++;
+            }
+            for (int key = 1; key <= numKeys; key++) {
+              starts[key] += starts[key - 1];
+            }
+            for (int i = spanBegin; i < spanEnd; i++) {
+              sorted[spanBegin + starts[sortKey(lineKeys[i])]++] = linePixels[i];
+            }
+            std::copy(sorted.begin() + spanBegin, sorted.begin() + spanEnd, linePixels.begin() + spanBegin);
+          }
+          spanBegin = spanEnd;
+        }
+
+        for (int i = 0; i < lineLength; i++) {
+          pixels[line * lineStride + i * pixelStride] = linePixels[i];
+        }
+      }
+    });
+  });
 }
@@ -13,60 +13,132 @@
 #include <numbers>
 #include <math.h>
 #include <filesystem>
+#include "pixel-buffer.h"
+#include "lut.h"
+#include "affine-transform.h"
+#include "resample-weights.h"
+#include "color-space.h"
+#include "counter-rng.h"
+#include "histogram.h"
+#include "convolution-kernel.h"
 
 using std::vector;
 using std::string;
 
 class PNM {
+  friend class Pipeline;
+
 private:
   std::filesystem::path filepath;
   int width;
   int height;
   int maxColor;
   int numChannels;
-  vector<unsigned char> data;
+  // 2 when maxColor is above 255, samples are then stored in native byte order
+  int bytesPerSample = 1;
+  PixelBuffer data;
 
-  void setMembers(std::filesystem::path filepath, int width, int height, int maxColor, int numChannels, vector<unsigned char> data);
+  // data is shared with whatever buffer it came from until either one writes
+  void setMembers(std::filesystem::path filepath, int width, int height, int maxColor, int numChannels, PixelBuffer data);
 
-  double normalRand(double sd, double mean);
-  int uniformRand(int min, int max);
+  // calls func with a null Pixel*, Pixel being std::array<sample type, channels> for this image
+  // pixel loops are compiled once per format instead of checking numChannels for every pixel
+  template <typename Func>
+  void dispatchPixelType(Func func);
 
-  int brightness(int pixIndex);
-  int luminence(int pixIndex, int standard=709);
+  void setChannel(int channel, int value);
 
-  void saltNoise(float noiseDensity);
-  void pepperNoise(float noiseDensity);
-  /* void gaussianNoise(double sd, double mean=0); */
+  // for filters that only have 8-bit kernels, rescales 16-bit samples to 0-255
+  void reduceToEightBit();
+  // converts 16-bit samples between the file's big-endian order and native order
+  static void swapSampleBytes(unsigned char* bytes, size_t size);
 
-  void pixelClip(int pixIndex);
+  int brightness(int pixIndex) const;
+  int luminence(int pixIndex, int standard=709) const;
 
-  void pixelSwap(int pixIndex1, int pixIndex2, vector<unsigned char>& vec);
+  // per-pixel kernels over a contiguous run of pixels, RGB-only ones take 3-channel pixels
+  static void grayscaleSpan(const unsigned char* src, unsigned char* dst, int numPixels, int standard);
+  static void invertSpan(unsigned char* samples, int numSamples, int maxColor);
+  static void sepiaSpan(unsigned char* pixels, int numPixels);
+  static void tintSpan(unsigned char* pixels, int numPixels, float r, float g, float b, float brightness);
+  static void thresholdSpan(unsigned char* samples, int numSamples, int epsilon);
+  static void channelSwapSpan(unsigned char* pixels, int numPixels, int channelOffset1, int channelOffset2);
 
-  vector<int> pixelHSL(int pixIndex);
-  
-  int partition(vector<unsigned char>& vec, int low, int high);
-  void quickSort(vector<unsigned char>& vec, int low, int high);
+  static void addNoiseBlock(unsigned char* samples, int count, const float (&noise)[CounterRNG::BLOCK], float amount);
+  static void impulseNoiseRow(unsigned char* pixels, int numPixels, int numChannels, const CounterRNG& rng, double density, bool salt, bool pepper);
+
+  template <typename Pixel>
+  void pixelClip(Pixel& pixel);
+
+  template <typename Pixel>
+  static void pixelSwap(Pixel* pixels, int pixel1, int pixel2);
+
+  // hue in degrees, saturation and lightness in percent
+  std::array<int, 3> pixelHSL(int pixIndex) const;
+
+  // one sort key per pixel, numKeys is one more than the largest key, 0 for an unknown criteria
+  vector<unsigned short> sortKeys(const string& sortCriteria, int& numKeys);
 
-  vector<int> rotateCoordinates(int row, int col, double theta);
+  // mirrors the pixels of rows [rowBegin, rowEnd) in place
+  void reverseRows(int rowBegin, int rowEnd);
+  // moves pixel (row, col) to (col, row) a block at a time, then mirrors the new columns and/or rows
+  void transposePixels(bool flipX, bool flipY);
+  // flips, quarter turns and transposes, exact and in place unless the axes are swapped
+  void orthogonalTransform(bool swapAxes, bool flipX, bool flipY);
+
+  // maps every output pixel center back through transform and samples the source there
+  void warpPixels(const AffineTransform& transform, int newWidth, int newHeight, string interpolation);
   
   double gaussian(int row, int col, double sd);
 
-  vector<unsigned char> meanBlur(int radius);
+  // maps coordinates -radius..size+radius-1 to in-bounds indices, -1 means zero padding
+  vector<int> borderIndices(int size, int radius, string borderMode);
+
+  vector<unsigned char> meanBlur(int radius, string borderMode="clamp");
+  vector<unsigned char> gaussianBlur(int radius, string borderMode="clamp");
+  // three box blurs approximating a gaussian, cost doesn't depend on the radius
+  vector<unsigned char> fastGaussianBlur(int radius, string borderMode="clamp");
+  // histogram based, cost per pixel barely depends on the radius
+  vector<unsigned char> medianBlur(int radius, string borderMode="clamp");
+  // convolves tiles of tileWidth * tileHeight in the frequency domain, sizes are powers of two
+  vector<unsigned char> convolveFFT(const ConvolutionKernel& kernel, string borderMode, int tileWidth, int tileHeight);
 
-  void testSort();
+  // leaves fin at the first byte of pixel data
+  bool readHeader(std::fstream& fin);
+  // rows of width pixels start stride bytes apart, only tightly packed rows can be memory mapped
+  bool writeFile(const std::filesystem::path& filepath, const unsigned char* pixels, size_t stride, int width, int height, int maxColor, int numChannels, bool memoryMap);
 
 public:
   PNM();
   PNM(const std::filesystem::path& filepath);
-  bool read(const std::filesystem::path& filepath);
+  // memoryMap maps the file instead of copying it, pages are only copied once they're modified
+  bool read(const std::filesystem::path& filepath, bool memoryMap=false);
 
   bool write();
   bool write(const std::filesystem::path& filepath);
-  bool write(const std::filesystem::path& filepath, vector<unsigned char> data, int width, int height, int maxColor, int numChannels);
+  // memoryMap preallocates the file and copies the pixels into a mapping of it
+  bool write(const std::filesystem::path& filepath, bool memoryMap);
+  bool write(const std::filesystem::path& filepath, const vector<unsigned char>& data, int width, int height, int maxColor, int numChannels);
+  // writes a rectangle of pixels in place, e.g. a view of part of an image
+  bool write(const std::filesystem::path& filepath, const ImageView& view, int maxColor=255);
+
+  // views share this image's pixels, they're invalidated by anything that replaces or resizes them
+  ImageView view();
+  // empty if the rectangle doesn't fit in the image
+  ImageView view(std::array<int, 2> upperLeft, int viewWidth, int viewHeight);
 
   int getWidth();
   int getHeight();
   int getNumChannels();
+  int getBytesPerSample();
+
+  // threads shared by every image's filters, 0 uses one per hardware core
+  static void setNumThreads(int numThreads);
+  static int getNumThreads();
+
+  // summed-area table with (width + 1) * (height + 1) entries per channel, interleaved like data
+  vector<uint64_t> integralImage();
+  uint64_t regionSum(const vector<uint64_t>& table, int row, int col, int regionHeight, int regionWidth, int channel=0);
 
   void setWidth(int width);
   void setHeight(int height);
@@ -85,17 +157,52 @@ public:
 
   void tint(float r, float g, float b, float brightness=1);
 
-  void noise(string type, float noiseDensity);
+  // types: "gaussian", amount is the standard deviation in 0-255 levels
+  //        "uniform", every sample moves up to amount levels either way
+  //        "salt", "pepper", "saltPepper", amount is the fraction of pixels turned white and/or black
+  // the same seed always gives the same noise, whatever the thread count
+  void noise(string type, float amount, uint64_t seed);
+  // draws a new seed every call
+  void noise(string type, float amount);
 
   // most basic image segmentation technique
   void threshold(int epsilon=100);
+  // methods: "otsu", "triangle", epsilon is picked from the grayscale histogram
+  // returns the epsilon used, -1 for an unknown method
+  int threshold(string method);
 
   void channelSwap(char channel1, char channel2);
 
-  void blur(string blurType, int radius);
+  // blur types: "mean", "gaussian", "fastGaussian", "median"
+  // border modes: "clamp", "reflect", "wrap", "zero"
+  void blur(string blurType, int radius, string borderMode="clamp");
 
   void chromaShift(int rshift, int gshift, int bshift, int threshold=0);
 
+  // tone operations, compiled to lookup tables so chains of them cost one pass
+  void applyLUT(const LUT& lut);
+  // gamma above 1 brightens
+  void gamma(double gamma);
+  void brightnessContrast(int brightness, double contrast=1);
+  // piecewise linear curve through (input, output) points
+  void curves(const vector<std::array<int, 2>>& points);
+
+  // histograms, counted in one pass with every thread filling its own bins
+  // 16-bit samples are counted by their 8-bit equivalents
+  Histogram histogram(bool withHSL=false) const;
+  // spreads the luminance histogram over 0-255, perChannel equalizes r, g and b separately instead
+  void equalize(bool perChannel=false);
+  // contrast limited adaptive equalization, each tile is equalized with its bins clipped to
+  // clipLimit times the mean bin and pixels blend the tables of the nearest four tiles
+  void clahe(int tilesAcross=8, int tilesDown=8, double clipLimit=2);
+
+  // color spaces, converted a band of rows per thread
+  ColorPlanes toColorPlanes(ColorSpace space);
+  // replaces the pixels with planes converted back, planes must hold width * height pixels
+  void fromColorPlanes(const ColorPlanes& planes);
+  // rotates hues by hueShift degrees and scales HSL saturation
+  void hueSaturation(double hueShift, double saturationScale=1);
+
   // image warps
  
   void verticalFlip();
@@ -104,15 +211,40 @@ public:
   void horizontalFlip();
   void horizontalReflection(char direction='l');
   
-  vector<PNM> combinedReflection();
+  vector<PNM> combinedReflection() const;
 
   void rectCrop(std::array<int, 2> upperLeft, int newWidth, int newHeight);
 
-  void rotate(double theta, bool degrees=true);
+  // affine warps resample the image once however many transforms are combined
+  // interpolation: "neighbor", "bilinear"
+  // the output is sized to fit the whole transformed image
+  void warp(const AffineTransform& transform, string interpolation="bilinear");
+  // maps straight into a newWidth x newHeight image, pixels mapped from outside the source are black
+  void warp(const AffineTransform& transform, int newWidth, int newHeight, string interpolation="bilinear");
+
+  void rotate(double theta, bool degrees=true, string interpolation="neighbor");
+  void shear(double shearX, double shearY, string interpolation="bilinear");
+
+  // exact quarter turns clockwise, negative turns go counterclockwise
+  void rotate90(int quarterTurns=1);
+  void transpose();
+  // applies an EXIF orientation tag (1-8) so the image displays upright
+  void orient(int orientation);
   
+  // unsharp mask using a gaussian blur
   void sharpen(double sharpness, int radius);
+  // any kernel, rank-1 kernels run as a horizontal and a vertical pass and large ones through the fft
+  // border modes: "clamp", "reflect", "wrap", "zero"
+  // methods: "auto" picks whichever should be fastest, "direct", "fft"
+  void convolve(const ConvolutionKernel& kernel, string borderMode="clamp", string method="auto");
 
+  // interpolation: "neighbor", "bilinear", "bicubic", "lanczos3", "area"
+  // resizes rows then columns with filter weights computed once per call
   void scale(double widthScale, double heightScale, string interpolation="neighbor");
 
-  void pixelSort(char direction, string sortCriteria, bool stable=false);
+  // sorts pixels along each row ('l', 'r') or column ('u', 'd'), keys increase toward direction
+  // sortCriteria: "brightness", "luminance" (0-255), "hue" (0-360), "saturation", "lightness" (0-100)
+  // only runs of pixels with keys in [spanLow, spanHigh] are sorted, the rest stay put
+  // the counting sort is always stable, stable is kept for existing callers
+  void pixelSort(char direction, string sortCriteria, bool stable=false, int spanLow=0, int spanHigh=360);
 };
@@ -0,0 +1,151 @@
+#include "instrumentation.h"
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+std::atomic<bool> Instrumentation::enabled{false};
+std::mutex Instrumentation::recordsMutex;
+std::vector<Instrumentation::Record> Instrumentation::records;
+std::chrono::steady_clock::time_point Instrumentation::epoch = std::chrono::steady_clock::now();
+
+thread_local InstrumentedScope* InstrumentedScope::current = nullptr;
+
+// private
+
+int Instrumentation::threadId() {
+  static std::atomic<int> nextId{1};
+  thread_local int id = nextId.fetch_add(1);
+  return id;
+}
+
+// public
+
+void Instrumentation::enable(bool enabled/*=true*/) {
+  Instrumentation::enabled.store(enabled);
+}
+
+std::vector<Instrumentation::Record> Instrumentation::getRecords() {
+  std::lock_guard<std::mutex> lock(recordsMutex);
+  return records;
+}
+
+std::map<std::string, Instrumentation::Totals> Instrumentation::getTotals() {
+  std::map<std::string, Totals> totals;
+
+  std::lock_guard<std::mutex> lock(recordsMutex);
+  for (const Record& record : records) {
+    Totals& total = totals[record.name];
+    total.calls++;
+    total.totalUs += record.durationUs;
+    total.pixels += record.pixels;
+    total.bytesRead += record.bytesRead;
+    total.bytesWritten += record.bytesWritten;
+    total.tempBytes += record.tempBytes;
+  }
+  return totals;
+}
+
+void Instrumentation::clear() {
+  std::lock_guard<std::mutex> lock(recordsMutex);
+  records.clear();
+}
+
+std::string Instrumentation::toJSON() {
+  std::stringstream json;
+  json << "{\n  \"operations\": [";
+
+  bool first = true;
+  for (const auto& [name, total] : getTotals()) {
+    json << (first ? "\n" : ",\n");
+    json << "    {\"name\": \"" << name << "\", \"calls\": " << total.calls << ", \"totalUs\": " << total.totalUs
+         << ", \"pixels\": " << total.pixels << ", \"bytesRead\": " << total.bytesRead << ", \"bytesWritten\": " << total.bytesWritten
+         << ", \"tempBytes\": " << total.tempBytes << "}";
+    first = false;
+  }
+  json << "\n  ],\n  \"records\": [";
+
+  first = true;
+  for (const Record& record : getRecords()) {
+    json << (first ? "\n" : ",\n");
+    json << "    {\"name\": \"" << record.name << "\", \"startUs\": " << record.startUs << ", \"durationUs\": " << record.durationUs
+         << ", \"pixels\": " << record.pixels << ", \"bytesRead\": " << record.bytesRead << ", \"bytesWritten\": " << record.bytesWritten
+         << ", \"tempBytes\": " << record.tempBytes << ", \"thread\": " << record.threadId << ", \"depth\": " << record.depth << "}";
+    first = false;
+  }
+  json << "\n  ]\n}\n";
+
+  return json.str();
+}
+
+std::string Instrumentation::toChromeTrace() {
+  std::stringstream trace;
+  trace << "{\"traceEvents\": [";
+
+  bool first = true;
+  for (const Record& record : getRecords()) {
+    trace << (first ? "\n" : ",\n");
+    trace << "  {\"name\": \"" << record.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << record.threadId
+          << ", \"ts\": " << record.startUs << ", \"dur\": " << record.durationUs
+          << ", \"args\": {\"pixels\": " << record.pixels << ", \"bytesRead\": " << record.bytesRead
+          << ", \"bytesWritten\": " << record.bytesWritten << ", \"tempBytes\": " << record.tempBytes << "}}";
+    first = false;
+  }
+  trace << "\n]}\n";
+
+  return trace.str();
+}
+
+bool Instrumentation::writeJSON(const std::filesystem::path& filepath) {
+  std::ofstream fout(filepath);
+  fout << toJSON();
+  return static_cast<bool>(fout);
+}
+bool Instrumentation::writeChromeTrace(const std::filesystem::path& filepath) {
+  std::ofstream fout(filepath);
+  fout << toChromeTrace();
+  return static_cast<bool>(fout);
+}
+
+void Instrumentation::recordAllocation(long long bytes) {
+  if (isEnabled() && InstrumentedScope::current) {
+    InstrumentedScope::current->tempBytes += bytes;
+  }
+}
+
+
+InstrumentedScope::InstrumentedScope(const char* name, long long pixels/*=0*/) {
+  active = Instrumentation::isEnabled();
+  if (!active) {
+    return;
+  }
+
+  this->name = name;
+  this->pixels = pixels;
+  parent = current;
+  depth = parent ? parent->depth + 1 : 0;
+  current = this;
+  start = std::chrono::steady_clock::now();
+}
+
+InstrumentedScope::~InstrumentedScope() {
+  if (!active) {
+    return;
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  current = parent;
+
+  Instrumentation::Record record;
+  record.name = name;
+  record.startUs = std::chrono::duration<double, std::micro>(start - Instrumentation::epoch).count();
+  record.durationUs = std::chrono::duration<double, std::micro>(end - start).count();
+  record.pixels = pixels;
+  record.bytesRead = bytesRead;
+  record.bytesWritten = bytesWritten;
+  record.tempBytes = tempBytes;
+  record.threadId = Instrumentation::threadId();
+  record.depth = depth;
+
+  std::lock_guard<std::mutex> lock(Instrumentation::recordsMutex);
+  Instrumentation::records.push_back(record);
+}
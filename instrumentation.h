@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+
+// opt-in per-operation timing and byte counters for PNM
+// when disabled a scope costs a single flag check, so it can stay compiled in
+class Instrumentation {
+public:
+  struct Record {
+    std::string name;
+    double startUs;
+    double durationUs;
+    long long pixels;
+    long long bytesRead;
+    long long bytesWritten;
+    long long tempBytes;
+    int threadId;
+    int depth;
+  };
+
+  struct Totals {
+    int calls = 0;
+    double totalUs = 0;
+    long long pixels = 0;
+    long long bytesRead = 0;
+    long long bytesWritten = 0;
+    long long tempBytes = 0;
+  };
+
+  static void enable(bool enabled=true);
+  static bool isEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+  }
+
+  static std::vector<Record> getRecords();
+  // records summed by operation name
+  static std::map<std::string, Totals> getTotals();
+  static void clear();
+
+  static std::string toJSON();
+  // chrome://tracing and Perfetto timeline
+  static std::string toChromeTrace();
+  static bool writeJSON(const std::filesystem::path& filepath);
+  static bool writeChromeTrace(const std::filesystem::path& filepath);
+
+  // adds to the innermost operation running on this thread
+  static void recordAllocation(long long bytes);
+
+private:
+  friend class InstrumentedScope;
+
+  static std::atomic<bool> enabled;
+  static std::mutex recordsMutex;
+  static std::vector<Record> records;
+  static std::chrono::steady_clock::time_point epoch;
+
+  static int threadId();
+};
+
+// times one call of a public PNM operation from construction to destruction
+class InstrumentedScope {
+private:
+  bool active;
+  const char* name;
+  std::chrono::steady_clock::time_point start;
+  long long pixels;
+  long long bytesRead = 0;
+  long long bytesWritten = 0;
+  long long tempBytes = 0;
+  InstrumentedScope* parent;
+  int depth;
+
+  static thread_local InstrumentedScope* current;
+
+  friend class Instrumentation;
+
+public:
+  InstrumentedScope(const char* name, long long pixels=0);
+  ~InstrumentedScope();
+
+  void setPixels(long long pixels) {
+    this->pixels = pixels;
+  }
+  void addBytesRead(long long bytes) {
+    bytesRead += bytes;
+  }
+  void addBytesWritten(long long bytes) {
+    bytesWritten += bytes;
+  }
+};
@@ -0,0 +1,156 @@
+#include "lut.h"
+#include <algorithm>
+#include <cmath>
+
+LUT::LUT() {
+  for (auto& table : tables) {
+    for (int value = 0; value < 256; value++) {
+      table[value] = value;
+    }
+  }
+}
+
+// factories
+
+LUT LUT::invert(int maxColor/*=255*/) {
+  LUT lut;
+  for (auto& table : lut.tables) {
+    for (int value = 0; value < 256; value++) {
+      // same wraparound as PNM::invertSpan for samples above maxColor
+      table[value] = maxColor - value;
+    }
+  }
+  return lut;
+}
+
+LUT LUT::threshold(int epsilon/*=100*/) {
+  LUT lut;
+  for (auto& table : lut.tables) {
+    for (int value = 0; value < 256; value++) {
+      table[value] = value > epsilon ? 255 : 0;
+    }
+  }
+  return lut;
+}
+
+LUT LUT::tint(float r, float g, float b, float brightness/*=1*/) {
+  const float factors[3] = {r, g, b};
+
+  LUT lut;
+  for (int channel = 0; channel < 3; channel++) {
+    for (int value = 0; value < 256; value++) {
+      float tinted = value * factors[channel] * brightness;
+      lut.tables[channel][value] = std::clamp(tinted, 0.0f, 255.0f);
+    }
+  }
+  return lut;
+}
+
+LUT LUT::setChannel(int channel, int value) {
+  LUT lut;
+  if (channel < 0 || channel > 2) {
+    return lut;
+  }
+
+  lut.tables[channel].fill(std::clamp(value, 0, 255));
+  return lut;
+}
+
+LUT LUT::gamma(double gamma, int maxColor/*=255*/) {
+  LUT lut;
+  if (gamma <= 0 || maxColor <= 0) {
+    return lut;
+  }
+
+  for (auto& table : lut.tables) {
+    for (int value = 0; value <= std::min(maxColor, 255); value++) {
+      table[value] = std::round(maxColor * std::pow((double)value / maxColor, 1 / gamma));
+    }
+  }
+  return lut;
+}
+
+LUT LUT::brightnessContrast(int brightness, double contrast/*=1*/, int maxColor/*=255*/) {
+  double middle = maxColor / 2.0;
+
+  LUT lut;
+  for (auto& table : lut.tables) {
+    for (int value = 0; value < 256; value++) {
+      double adjusted = (value - middle) * contrast + middle + brightness;
+      table[value] = std::clamp<double>(std::round(adjusted), 0, maxColor);
+    }
+  }
+  return lut;
+}
+
+LUT LUT::curves(std::vector<std::array<int, 2>> points) {
+  LUT lut;
+  if (points.empty()) {
+    return lut;
+  }
+
+  std::sort(points.begin(), points.end());
+
+  for (auto& table : lut.tables) {
+    int segment = 0;
+    for (int value = 0; value < 256; value++) {
+      while (segment < (int)points.size() && points[segment][0] < value) {
+        segment++;
+      }
+
+      double output;
+      if (segment == 0) {
+        output = points.front()[1];
+      }
+      else if (segment == (int)points.size()) {
+        output = points.back()[1];
+      }
+      else {
+        // points[segment - 1] is left of value, points[segment] is at or right of it
+        const std::array<int, 2>& left = points[segment - 1];
+        const std::array<int, 2>& right = points[segment];
+        output = left[1] + (double)(value - left[0]) * (right[1] - left[1]) / (right[0] - left[0]);
+      }
+      table[value] = std::clamp<double>(std::round(output), 0, 255);
+    }
+  }
+  return lut;
+}
+
+// composition and application
+
+unsigned char& LUT::at(int channel, int value) {
+  return tables[channel][value];
+}
+unsigned char LUT::at(int channel, int value) const {
+  return tables[channel][value];
+}
+
+LUT LUT::then(const LUT& next) const {
+  LUT combined;
+  for (int channel = 0; channel < 4; channel++) {
+    for (int value = 0; value < 256; value++) {
+      combined.tables[channel][value] = next.tables[channel][tables[channel][value]];
+    }
+  }
+  return combined;
+}
+
+void LUT::apply(unsigned char* pixels, int numPixels, int numChannels) const {
+  if (numChannels == 1) {
+    const unsigned char* gray = tables[GRAY].data();
+    for (int i = 0; i < numPixels; i++) {
+      pixels[i] = gray[pixels[i]];
+    }
+    return;
+  }
+
+  const unsigned char* r = tables[0].data();
+  const unsigned char* g = tables[1].data();
+  const unsigned char* b = tables[2].data();
+  for (int i = 0; i < numPixels * 3; i += 3) {
+    pixels[i] = r[pixels[i]];
+    pixels[i + 1] = g[pixels[i + 1]];
+    pixels[i + 2] = b[pixels[i + 2]];
+  }
+}
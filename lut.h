@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+// 256-entry lookup tables for point operations on 8-bit samples, one table per channel
+// chains of tables compose into one, so any number of tone operations costs a single pass
+class LUT {
+private:
+  // r, g and b tables, then the one single channel images use
+  std::array<std::array<unsigned char, 256>, 4> tables;
+
+public:
+  static const int GRAY = 3;
+
+  // identity tables
+  LUT();
+
+  static LUT invert(int maxColor=255);
+  static LUT threshold(int epsilon=100);
+  // r, g and b are already normalized to 0-1 like PNM::tintSpan, single channel samples are left alone
+  static LUT tint(float r, float g, float b, float brightness=1);
+  // channel is 0-2, single channel samples are left alone
+  static LUT setChannel(int channel, int value);
+  // gamma above 1 brightens
+  static LUT gamma(double gamma, int maxColor=255);
+  // contrast scales around the middle of the range, brightness is added afterwards
+  static LUT brightnessContrast(int brightness, double contrast=1, int maxColor=255);
+  // piecewise linear curve through (input, output) points, flat past the first and last point
+  static LUT curves(std::vector<std::array<int, 2>> points);
+
+  unsigned char& at(int channel, int value);
+  unsigned char at(int channel, int value) const;
+
+  // applies this table, then next
+  LUT then(const LUT& next) const;
+
+  void apply(unsigned char* pixels, int numPixels, int numChannels) const;
+};
@@ -0,0 +1,585 @@
+#include "pipeline.h"
+#include "thread-pool.h"
+#include "instrumentation.h"
+#include "buffer-pool.h"
+
+// private
+
+Pipeline& Pipeline::addPixelOperation(std::function<int(unsigned char*, int, int, int)> pixelKernel, bool makesGrayscale/*=false*/) {
+  operations.push_back({pixelKernel, nullptr, nullptr, makesGrayscale, 0, std::nullopt, ""});
+  return *this;
+}
+Pipeline& Pipeline::addImageOperation(std::function<void(PNM&)> imageOperation, int halo/*=-1*/) {
+  operations.push_back({nullptr, imageOperation, nullptr, false, halo, std::nullopt, ""});
+  return *this;
+}
+Pipeline& Pipeline::addLUTOperation(std::function<LUT(int)> lut, std::function<int(unsigned char*, int, int, int)> pixelKernel/*=nullptr*/) {
+  operations.push_back({pixelKernel, nullptr, lut, false, 0, std::nullopt, ""});
+  return *this;
+}
+Pipeline& Pipeline::addAffineOperation(const AffineTransform& transform, string interpolation) {
+  auto warp = [=](PNM& img) { img.warp(transform, interpolation); };
+  operations.push_back({nullptr, warp, nullptr, false, -1, transform, interpolation});
+  return *this;
+}
+
+vector<Pipeline::PixelKernel> Pipeline::pixelKernels(int first, int last, int maxColor) {
+  // a lone operation with its own kernel keeps it, that's vectorized where a table lookup isn't
+  vector<PixelKernel> kernels;
+  for (int i = first; i < last;) {
+    int runEnd = i;
+    while (runEnd < last && operations[runEnd].lut) {
+      runEnd++;
+    }
+
+    if (runEnd - i < 2 && operations[i].pixelKernel) {
+      kernels.push_back(operations[i].pixelKernel);
+      i++;
+      continue;
+    }
+
+    LUT table = operations[i].lut(maxColor);
+    for (int j = i + 1; j < runEnd; j++) {
+      table = table.then(operations[j].lut(maxColor));
+    }
+    kernels.push_back([table](unsigned char* pixels, int numPixels, int numChannels, int) {
+      table.apply(pixels, numPixels, numChannels);
+      return numChannels;
+    });
+    i = runEnd;
+  }
+  return kernels;
+}
+
+// runs operations [first, last) block by block so each block stays in cache between operations
+void Pipeline::runPixelOperations(PNM& img, int first, int last) {
+  const int BLOCK_PIXELS = 4096;
+
+  int numPixels = img.width * img.height;
+  int numBlocks = (numPixels + BLOCK_PIXELS - 1) / BLOCK_PIXELS;
+  int inChannels = img.numChannels;
+
+  int outChannels = inChannels;
+  for (int i = first; i < last; i++) {
+    if (operations[i].makesGrayscale) {
+      outChannels = 1;
+    }
+  }
+
+  // channels only ever shrink, blocks can't write in place then as a later block's pixels would be overwritten
+  vector<unsigned char> newImgData;
+  if (outChannels != inChannels) {
+    newImgData = BufferPool::acquire(numPixels * outChannels);
+  }
+
+  vector<PixelKernel> kernels = pixelKernels(first, last, img.maxColor);
+
+  // blocks are copied out when the channels change, the source is only read then
+  unsigned char* imgPixels = outChannels == inChannels ? img.data.data() : nullptr;
+  const unsigned char* sourcePixels = std::as_const(img.data).data();
+
+  ThreadPool::shared().parallelFor(numBlocks, [&](int blockBegin, int blockEnd) {
+    vector<unsigned char> blockBuffer;
+    if (outChannels != inChannels) {
+      blockBuffer.resize(BLOCK_PIXELS * inChannels);
+    }
+
+    for (int block = blockBegin; block < blockEnd; block++) {
+      int firstPixel = block * BLOCK_PIXELS;
+      int blockPixels = std::min(BLOCK_PIXELS, numPixels - firstPixel);
+
+      unsigned char* pixels = imgPixels + firstPixel * inChannels;
+      if (outChannels != inChannels) {
+        std::memcpy(blockBuffer.data(), sourcePixels + firstPixel * inChannels, blockPixels * inChannels);
+        pixels = blockBuffer.data();
+      }
+
+      int channels = inChannels;
+      for (auto& kernel : kernels) {
+        channels = kernel(pixels, blockPixels, channels, img.maxColor);
+      }
+
+      if (outChannels != inChannels) {
+        std::memcpy(&newImgData[firstPixel * outChannels], pixels, blockPixels * outChannels);
+      }
+    }
+  });
+
+  if (outChannels != inChannels) {
+    img.data = std::move(newImgData);
+    img.numChannels = outChannels;
+  }
+}
+
+// PNM falls back to clamp for anything else, so a misspelled mode has to be caught here
+static bool isBorderMode(const string& mode) {
+  return mode == "clamp" || mode == "reflect" || mode == "wrap" || mode == "zero";
+}
+
+// public
+
+Pipeline& Pipeline::grayscale(int standard/*=709*/) {
+  return addPixelOperation([standard](unsigned char* pixels, int numPixels, int numChannels, int maxColor) {
+    if (numChannels == 1) {
+      return 1;
+    }
+    PNM::grayscaleSpan(pixels, pixels, numPixels, standard);
+    return 1;
+  }, true);
+}
+Pipeline& Pipeline::invertColor() {
+  return addLUTOperation([](int maxColor) { return LUT::invert(maxColor); },
+    [](unsigned char* pixels, int numPixels, int numChannels, int maxColor) {
+      PNM::invertSpan(pixels, numPixels * numChannels, maxColor);
+      return numChannels;
+    });
+}
+Pipeline& Pipeline::sepia() {
+  return addPixelOperation([](unsigned char* pixels, int numPixels, int numChannels, int maxColor) {
+    if (numChannels == 3) {
+      PNM::sepiaSpan(pixels, numPixels);
+    }
+    return numChannels;
+  });
+}
+Pipeline& Pipeline::tint(float r, float g, float b, float brightness/*=1*/) {
+  r /= 255;
+  g /= 255;
+  b /= 255;
+
+  return addLUTOperation([r, g, b, brightness](int maxColor) { return LUT::tint(r, g, b, brightness); },
+    [r, g, b, brightness](unsigned char* pixels, int numPixels, int numChannels, int maxColor) {
+      if (numChannels == 3) {
+        PNM::tintSpan(pixels, numPixels, r, g, b, brightness);
+      }
+      return numChannels;
+    });
+}
+Pipeline& Pipeline::threshold(int epsilon/*=100*/) {
+  grayscale();
+  return addLUTOperation([epsilon](int maxColor) { return LUT::threshold(epsilon); },
+    [epsilon](unsigned char* pixels, int numPixels, int numChannels, int maxColor) {
+      PNM::thresholdSpan(pixels, numPixels * numChannels, epsilon);
+      return numChannels;
+    });
+}
+Pipeline& Pipeline::channelSwap(char channel1, char channel2) {
+  std::map<char, int> channelToIndex;
+  channelToIndex['r'] = 0;
+  channelToIndex['g'] = 1;
+  channelToIndex['b'] = 2;
+
+  int channelOffset1 = channelToIndex[channel1];
+  int channelOffset2 = channelToIndex[channel2];
+
+  return addPixelOperation([channelOffset1, channelOffset2](unsigned char* pixels, int numPixels, int numChannels, int maxColor) {
+    if (numChannels == 3) {
+      PNM::channelSwapSpan(pixels, numPixels, channelOffset1, channelOffset2);
+    }
+    return numChannels;
+  });
+}
+
+Pipeline& Pipeline::gamma(double gamma) {
+  return addLUTOperation([gamma](int maxColor) { return LUT::gamma(gamma, maxColor); });
+}
+Pipeline& Pipeline::brightnessContrast(int brightness, double contrast/*=1*/) {
+  return addLUTOperation([brightness, contrast](int maxColor) { return LUT::brightnessContrast(brightness, contrast, maxColor); });
+}
+Pipeline& Pipeline::curves(const vector<std::array<int, 2>>& points) {
+  return addLUTOperation([points](int maxColor) { return LUT::curves(points); });
+}
+
+Pipeline& Pipeline::blur(string blurType, int radius, string borderMode/*="clamp"*/) {
+  // wrapping needs rows from the other end of the image
+  // fastGaussian's three box radii never add up to more than radius
+  int halo = borderMode == "wrap" ? -1 : std::max(radius, 0);
+  return addImageOperation([=](PNM& img) { img.blur(blurType, radius, borderMode); }, halo);
+}
+Pipeline& Pipeline::sharpen(double sharpness, int radius) {
+  return addImageOperation([=](PNM& img) { img.sharpen(sharpness, radius); }, std::max(radius, 0));
+}
+Pipeline& Pipeline::convolve(const ConvolutionKernel& kernel, string borderMode/*="clamp"*/) {
+  int halo = borderMode == "wrap" ? -1 : std::max(kernel.getWidth(), kernel.getHeight()) / 2;
+  return addImageOperation([=](PNM& img) { img.convolve(kernel, borderMode); }, halo);
+}
+Pipeline& Pipeline::noise(string type, float amount, uint64_t seed/*=0*/) {
+  return addImageOperation([=](PNM& img) {
+    img.noise(type, amount, seed ^ std::hash<string>()(img.filepath.filename().string()));
+  });
+}
+Pipeline& Pipeline::chromaShift(int rshift, int gshift, int bshift, int threshold/*=0*/) {
+  return addImageOperation([=](PNM& img) { img.chromaShift(rshift, gshift, bshift, threshold); });
+}
+
+Pipeline& Pipeline::threshold(string method) {
+  return addImageOperation([=](PNM& img) { img.threshold(method); });
+}
+Pipeline& Pipeline::equalize(bool perChannel/*=false*/) {
+  return addImageOperation([=](PNM& img) { img.equalize(perChannel); });
+}
+Pipeline& Pipeline::clahe(int tilesAcross/*=8*/, int tilesDown/*=8*/, double clipLimit/*=2*/) {
+  return addImageOperation([=](PNM& img) { img.clahe(tilesAcross, tilesDown, clipLimit); });
+}
+
+Pipeline& Pipeline::verticalFlip() {
+  return addImageOperation([](PNM& img) { img.verticalFlip(); });
+}
+Pipeline& Pipeline::horizontalFlip() {
+  return addImageOperation([](PNM& img) { img.horizontalFlip(); });
+}
+Pipeline& Pipeline::rectCrop(std::array<int, 2> upperLeft, int newWidth, int newHeight) {
+  return addImageOperation([=](PNM& img) { img.rectCrop(upperLeft, newWidth, newHeight); });
+}
+Pipeline& Pipeline::rotate(double theta, bool degrees/*=true*/, string interpolation/*="neighbor"*/) {
+  return addAffineOperation(AffineTransform::rotation(theta, degrees), interpolation);
+}
+Pipeline& Pipeline::shear(double shearX, double shearY, string interpolation/*="bilinear"*/) {
+  return addAffineOperation(AffineTransform::shear(shearX, shearY), interpolation);
+}
+Pipeline& Pipeline::warp(const AffineTransform& transform, string interpolation/*="bilinear"*/) {
+  return addAffineOperation(transform, interpolation);
+}
+Pipeline& Pipeline::scale(double widthScale, double heightScale, string interpolation/*="neighbor"*/) {
+  return addImageOperation([=](PNM& img) { img.scale(widthScale, heightScale, interpolation); });
+}
+
+int Pipeline::size() {
+  return operations.size();
+}
+void Pipeline::clear() {
+  operations.clear();
+}
+
+bool Pipeline::parse(const string& description) {
+  std::stringstream operationStream(description);
+  string operationText;
+  int previousSize = operations.size();
+
+  while (std::getline(operationStream, operationText, ';')) {
+    std::stringstream words(operationText);
+    string name;
+    if (!(words >> name)) {
+      continue; // empty operation, e.g. a trailing ';'
+    }
+
+    bool valid = true;
+    if (name == "grayscale") {
+      int standard = 709;
+      words >> standard;
+      grayscale(standard);
+    }
+    else if (name == "invert" || name == "invertColor") {
+      invertColor();
+    }
+    else if (name == "sepia") {
+      sepia();
+    }
+    else if (name == "tint") {
+      float r, g, b, brightness = 1;
+      valid = static_cast<bool>(words >> r >> g >> b);
+      words >> brightness;
+      tint(r, g, b, brightness);
+    }
+    else if (name == "threshold") {
+      // a number, or "otsu" / "triangle" to pick one from the image's histogram
+      string epsilon = "100";
+      words >> epsilon;
+      if (epsilon == "otsu" || epsilon == "triangle") {
+        threshold(epsilon);
+      }
+      else {
+        std::stringstream number(epsilon);
+        int value;
+        valid = static_cast<bool>(number >> value);
+        threshold(value);
+      }
+    }
+    else if (name == "channelSwap") {
+      char channel1, channel2;
+      valid = static_cast<bool>(words >> channel1 >> channel2);
+      channelSwap(channel1, channel2);
+    }
+    else if (name == "gamma") {
+      double gammaValue;
+      valid = static_cast<bool>(words >> gammaValue);
+      gamma(gammaValue);
+    }
+    else if (name == "brightnessContrast") {
+      int brightness;
+      double contrast = 1;
+      valid = static_cast<bool>(words >> brightness);
+      words >> contrast;
+      brightnessContrast(brightness, contrast);
+    }
+    else if (name == "curves") {
+      // input:output pairs, e.g. "curves 0:0 128:160 255:255"
+      vector<std::array<int, 2>> points;
+      int input, output;
+      char separator;
+      while (words >> input >> separator >> output) {
+        valid = valid && separator == ':';
+        points.push_back({input, output});
+      }
+      valid = valid && !points.empty();
+      curves(points);
+    }
+    else if (name == "blur") {
+      string blurType, borderMode = "clamp";
+      int radius;
+      valid = static_cast<bool>(words >> blurType >> radius);
+      words >> borderMode;
+      valid = valid && (blurType == "mean" || blurType == "gaussian" || blurType == "fastGaussian" || blurType == "median") &&
+              isBorderMode(borderMode);
+      blur(blurType, radius, borderMode);
+    }
+    else if (name == "sharpen") {
+      double sharpness;
+      int radius;
+      valid = static_cast<bool>(words >> sharpness >> radius);
+      sharpen(sharpness, radius);
+    }
+    else if (name == "convolve") {
+      // a kernel name, e.g. "convolve sobelX" or "convolve disk 15", or width, height and the weights
+      // row by row, e.g. "convolve 3 3 0 -1 0 -1 5 -1 0 -1 0", then an optional border mode
+      string first, borderMode = "clamp";
+      ConvolutionKernel kernel;
+      valid = static_cast<bool>(words >> first);
+      if (valid && ConvolutionKernel::named(first, kernel)) {
+        int radius;
+        std::streampos position = words.tellg();
+        if (words >> radius) {
+          ConvolutionKernel::named(first, kernel, radius);
+        }
+        else {
+          words.clear();
+          words.seekg(position);
+        }
+      }
+      else if (valid) {
+        std::stringstream number(first);
+        int kernelWidth, kernelHeight;
+        valid = static_cast<bool>(number >> kernelWidth) && static_cast<bool>(words >> kernelHeight) && kernelWidth > 0 && kernelHeight > 0;
+        vector<double> weights(valid ? kernelWidth * kernelHeight : 0);
+        for (double& weight : weights) {
+          valid = valid && static_cast<bool>(words >> weight);
+        }
+        kernel = ConvolutionKernel(kernelWidth, kernelHeight, weights);
+      }
+      words >> borderMode;
+      valid = valid && isBorderMode(borderMode);
+      convolve(kernel, borderMode);
+    }
+    else if (name == "noise") {
+      string type;
+      float amount;
+      uint64_t seed = 0;
+      valid = static_cast<bool>(words >> type >> amount);
+      words >> seed;
+      noise(type, amount, seed);
+    }
+    else if (name == "equalize") {
+      string mode;
+      words >> mode;
+      valid = mode.empty() || mode == "perChannel";
+      equalize(mode == "perChannel");
+    }
+    else if (name == "clahe") {
+      int tilesAcross = 8, tilesDown = 8;
+      double clipLimit = 2;
+      words >> tilesAcross >> tilesDown >> clipLimit;
+      clahe(tilesAcross, tilesDown, clipLimit);
+    }
+    else if (name == "chromaShift") {
+      int rshift, gshift, bshift, threshold = 0;
+      valid = static_cast<bool>(words >> rshift >> gshift >> bshift);
+      words >> threshold;
+      chromaShift(rshift, gshift, bshift, threshold);
+    }
+    else if (name == "verticalFlip") {
+      verticalFlip();
+    }
+    else if (name == "horizontalFlip") {
+      horizontalFlip();
+    }
+    else if (name == "crop" || name == "rectCrop") {
+      int row, col, newWidth, newHeight;
+      valid = static_cast<bool>(words >> row >> col >> newWidth >> newHeight);
+      rectCrop({row, col}, newWidth, newHeight);
+    }
+    else if (name == "rotate") {
+      double theta;
+      string interpolation = "neighbor";
+      valid = static_cast<bool>(words >> theta);
+      words >> interpolation;
+      rotate(theta, true, interpolation);
+    }
+    else if (name == "shear") {
+      double shearX, shearY;
+      string interpolation = "bilinear";
+      valid = static_cast<bool>(words >> shearX >> shearY);
+      words >> interpolation;
+      shear(shearX, shearY, interpolation);
+    }
+    else if (name == "scale") {
+      double widthScale, heightScale;
+      string interpolation = "neighbor";
+      valid = static_cast<bool>(words >> widthScale >> heightScale);
+      words >> interpolation;
+      scale(widthScale, heightScale, interpolation);
+    }
+    else {
+      valid = false;
+    }
+
+    if (!valid) {
+      std::cerr << "Error: Invalid operation \"" << operationText << "\"" << std::endl;
+      operations.erase(operations.begin() + previousSize, operations.end());
+      return false;
+    }
+  }
+  return true;
+}
+
+void Pipeline::run(PNM& img) {
+  InstrumentedScope scope("pipeline", (long long)img.width * img.height);
+  int i = 0;
+  while (i < operations.size()) {
+    if (operations[i].transform) {
+      // the combined transform is fitted once, bilinear if any of them asked for it
+      AffineTransform transform = *operations[i].transform;
+      string interpolation = operations[i].interpolation;
+      int last = i + 1;
+      while (last < operations.size() && operations[last].transform) {
+        transform = transform.then(*operations[last].transform);
+        if (operations[last].interpolation == "bilinear") {
+          interpolation = "bilinear";
+        }
+        last++;
+      }
+      img.warp(transform, interpolation);
+      i = last;
+      continue;
+    }
+
+    if (operations[i].imageOperation) {
+      operations[i].imageOperation(img);
+      i++;
+      continue;
+    }
+
+    int last = i;
+    while (last < operations.size() && !operations[last].imageOperation) {
+      last++;
+    }
+    InstrumentedScope fusedScope("fusedPixelOperations", (long long)img.width * img.height);
+    img.reduceToEightBit(); // per-pixel kernels are 8-bit only
+    runPixelOperations(img, i, last);
+    i = last;
+  }
+}
+
+bool Pipeline::run(const ImageView& region, int maxColor/*=255*/) {
+  for (Operation& operation : operations) {
+    if (operation.imageOperation || operation.makesGrayscale) {
+      std::cerr << "Error: Only per-pixel operations that keep the channels can run on a region" << std::endl;
+      return false;
+    }
+  }
+  if (region.empty() || region.bytesPerSample != 1) {
+    return false;
+  }
+
+  InstrumentedScope scope("pipelineRegion", (long long)region.width * region.height);
+  vector<PixelKernel> kernels = pixelKernels(0, operations.size(), maxColor);
+
+  // a row of the region is contiguous, so each one is a block
+  ThreadPool::shared().parallelFor(region.height, [&](int rowBegin, int rowEnd) {
+    for (int row = rowBegin; row < rowEnd; row++) {
+      for (auto& kernel : kernels) {
+        kernel(region.row(row), region.width, region.numChannels, maxColor);
+      }
+    }
+  });
+  return true;
+}
+
+bool Pipeline::stream(const std::filesystem::path& inputPath, const std::filesystem::path& outputPath, int stripHeight/*=256*/) {
+  // halos add up, each operation needs its input correct that much further out
+  int halo = 0;
+  bool makesGrayscale = false;
+  for (Operation& operation : operations) {
+    if (operation.halo < 0) {
+      std::cerr << "Error: Pipeline has an operation that can't be streamed" << std::endl;
+      return false;
+    }
+    halo += operation.halo;
+    makesGrayscale = makesGrayscale || operation.makesGrayscale;
+  }
+
+  std::fstream fin;
+  fin.open(inputPath, std::ios::in | std::ios::binary);
+  if (!fin) {
+    std::cerr << "Error: Failed to open " << inputPath << std::endl;
+    return false;
+  }
+
+  PNM strip;
+  if (!strip.readHeader(fin)) {
+    return false;
+  }
+  if (strip.bytesPerSample != 1) {
+    std::cerr << "Error: Only 8-bit files can be streamed" << std::endl;
+    return false;
+  }
+  int width = strip.width;
+  int height = strip.height;
+  int inChannels = strip.numChannels;
+  int outChannels = makesGrayscale ? 1 : inChannels;
+  size_t payloadOffset = fin.tellg();
+  size_t inRowLength = width * inChannels;
+  size_t outRowLength = width * outChannels;
+
+  std::filesystem::path outputFile = outputPath;
+  outputFile.replace_extension(outChannels == 3 ? ".ppm" : ".pgm");
+  if (outputFile.has_parent_path()) {
+    std::filesystem::create_directories(outputFile.parent_path());
+  }
+
+  std::fstream fout;
+  fout.open(outputFile, std::ios::out | std::ios::binary);
+  if (!fout) {
+    std::cerr << "Error: Failed to open " << outputFile << std::endl;
+    return false;
+  }
+  fout << (outChannels == 3 ? "P6\n" : "P5\n") << width << " " << height << "\n" << strip.maxColor << "\n";
+
+  stripHeight = std::max(stripHeight, 1);
+  for (int stripTop = 0; stripTop < height; stripTop += stripHeight) {
+    int stripBottom = std::min(stripTop + stripHeight, height);
+
+    // halo rows are read again by the next strip instead of being kept around
+    int readTop = std::max(stripTop - halo, 0);
+    int readBottom = std::min(stripBottom + halo, height);
+
+    strip.width = width;
+    strip.height = readBottom - readTop;
+    strip.numChannels = inChannels;
+    strip.data.resize(strip.height * inRowLength);
+
+    fin.seekg(payloadOffset + readTop * inRowLength);
+    fin.read(reinterpret_cast<char*>(strip.data.data()), strip.data.size());
+    if (!fin) {
+      std::cerr << "Error: Failed to read pixel data" << std::endl;
+      return false;
+    }
+
+    run(strip);
+
+    // rows within the halo of an inner strip edge were blurred with the wrong neighbors, only the middle is kept
+    fout.write(reinterpret_cast<const char*>(&strip.data[(stripTop - readTop) * outRowLength]), (stripBottom - stripTop) * outRowLength);
+  }
+
+  fout.close();
+  return true;
+}
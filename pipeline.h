@@ -0,0 +1,93 @@
+#pragma once
+
+#include "image-processor.h"
+#include <functional>
+#include <optional>
+#include <sstream>
+
+// records PNM operations and runs them later, consecutive per-pixel operations are fused
+// into a single pass over the image, full intermediate images are only made by blurs and warps
+// consecutive tone operations are composed into one lookup table first
+class Pipeline {
+private:
+  struct Operation {
+    // per-pixel operations work in place on a block of pixels and return the new channel count
+    std::function<int(unsigned char* pixels, int numPixels, int numChannels, int maxColor)> pixelKernel;
+    // every other operation runs on the whole image
+    std::function<void(PNM& img)> imageOperation;
+    // builds the operation's lookup table, runs of table operations are composed into one
+    std::function<LUT(int maxColor)> lut;
+    bool makesGrayscale;
+    // rows above and below an output row that it depends on, -1 if the operation can't run on strips
+    int halo;
+    // set for affine warps, runs of them are combined into one warp
+    std::optional<AffineTransform> transform;
+    string interpolation;
+  };
+
+  vector<Operation> operations;
+
+  using PixelKernel = std::function<int(unsigned char*, int, int, int)>;
+  // kernels for operations [first, last), runs of table operations become one table
+  vector<PixelKernel> pixelKernels(int first, int last, int maxColor);
+
+  Pipeline& addPixelOperation(std::function<int(unsigned char*, int, int, int)> pixelKernel, bool makesGrayscale=false);
+  Pipeline& addImageOperation(std::function<void(PNM&)> imageOperation, int halo=-1);
+  Pipeline& addAffineOperation(const AffineTransform& transform, string interpolation);
+  // pixelKernel is used instead of the table when the operation isn't next to another table operation
+  Pipeline& addLUTOperation(std::function<LUT(int)> lut, std::function<int(unsigned char*, int, int, int)> pixelKernel=nullptr);
+
+  void runPixelOperations(PNM& img, int first, int last);
+
+public:
+  // point operations, fused
+  Pipeline& grayscale(int standard=709);
+  Pipeline& invertColor();
+  Pipeline& sepia();
+  Pipeline& tint(float r, float g, float b, float brightness=1);
+  Pipeline& threshold(int epsilon=100);
+  Pipeline& channelSwap(char channel1, char channel2);
+  Pipeline& gamma(double gamma);
+  Pipeline& brightnessContrast(int brightness, double contrast=1);
+  Pipeline& curves(const vector<std::array<int, 2>>& points);
+
+  // neighborhood operations
+  Pipeline& blur(string blurType, int radius, string borderMode="clamp");
+  Pipeline& sharpen(double sharpness, int radius);
+  Pipeline& convolve(const ConvolutionKernel& kernel, string borderMode="clamp");
+  Pipeline& chromaShift(int rshift, int gshift, int bshift, int threshold=0);
+  // the seed is mixed with the image's file name, so a batch gives every file its own noise, the same on every run
+  Pipeline& noise(string type, float amount, uint64_t seed=0);
+
+  // histogram operations, they need the whole image counted before any pixel changes
+  Pipeline& threshold(string method);
+  Pipeline& equalize(bool perChannel=false);
+  Pipeline& clahe(int tilesAcross=8, int tilesDown=8, double clipLimit=2);
+
+  // warps
+  Pipeline& verticalFlip();
+  Pipeline& horizontalFlip();
+  Pipeline& rectCrop(std::array<int, 2> upperLeft, int newWidth, int newHeight);
+  // consecutive rotates, shears and warps are combined and resample the image once
+  Pipeline& rotate(double theta, bool degrees=true, string interpolation="neighbor");
+  Pipeline& shear(double shearX, double shearY, string interpolation="bilinear");
+  Pipeline& warp(const AffineTransform& transform, string interpolation="bilinear");
+  Pipeline& scale(double widthScale, double heightScale, string interpolation="neighbor");
+
+  int size();
+  void clear();
+
+  // appends operations from text like "grayscale; blur mean 3; threshold 100", returns false on unknown operations
+  bool parse(const string& description);
+
+  // applies every recorded operation to img
+  void run(PNM& img);
+  // applies the recorded per-pixel operations in place to an 8-bit region, e.g. one from PNM::view
+  // returns false if an operation needs the whole image or makes it grayscale
+  bool run(const ImageView& region, int maxColor=255);
+
+  // runs the pipeline on horizontal strips of a P5/P6 file, writing each strip as it's done
+  // memory use is set by stripHeight plus the halo rows blurs need, not by the image size
+  // warps, chromaShift and wrapped borders need the whole image and aren't supported
+  bool stream(const std::filesystem::path& inputPath, const std::filesystem::path& outputPath, int stripHeight=256);
+};
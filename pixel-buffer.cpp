@@ -0,0 +1,232 @@
+#include "pixel-buffer.h"
+#include "buffer-pool.h"
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define PIXEL_BUFFER_MMAP
+#endif
+
+// storage
+
+PixelBuffer::Storage::Storage(std::vector<unsigned char>&& pixels) : owned(std::move(pixels)) {
+  this->pixels = owned.data();
+  size = owned.size();
+}
+
+PixelBuffer::Storage::~Storage() {
+  unmap();
+  BufferPool::recycle(std::move(owned));
+}
+
+void PixelBuffer::Storage::unmap() {
+#ifdef PIXEL_BUFFER_MMAP
+  if (mapping) {
+    munmap(mapping, mappingLength);
+  }
+#endif
+  mapping = nullptr;
+  mappingLength = 0;
+  mappedPath.clear();
+  pixels = owned.data();
+  size = owned.size();
+}
+
+// private
+
+void PixelBuffer::makeUnique() {
+  if (storage.use_count() > 1) {
+    std::vector<unsigned char> copy = BufferPool::acquire(storage->size);
+    std::memcpy(copy.data(), storage->pixels, storage->size);
+    storage = std::make_shared<Storage>(std::move(copy));
+  }
+}
+
+// public
+
+PixelBuffer::PixelBuffer() {}
+PixelBuffer::PixelBuffer(const std::vector<unsigned char>& pixels) : storage(std::make_shared<Storage>(std::vector<unsigned char>(pixels))) {}
+PixelBuffer::PixelBuffer(std::vector<unsigned char>&& pixels) : storage(std::make_shared<Storage>(std::move(pixels))) {}
+PixelBuffer::PixelBuffer(const PixelBuffer& other) : storage(other.storage) {}
+PixelBuffer::PixelBuffer(PixelBuffer&& other) noexcept : storage(std::move(other.storage)) {}
+PixelBuffer::~PixelBuffer() {}
+
+PixelBuffer& PixelBuffer::operator=(const PixelBuffer& other) {
+  storage = other.storage;
+  return *this;
+}
+PixelBuffer& PixelBuffer::operator=(PixelBuffer&& other) noexcept {
+  storage = std::move(other.storage);
+  return *this;
+}
+PixelBuffer& PixelBuffer::operator=(const std::vector<unsigned char>& pixels) {
+  storage = std::make_shared<Storage>(std::vector<unsigned char>(pixels));
+  return *this;
+}
+PixelBuffer& PixelBuffer::operator=(std::vector<unsigned char>&& pixels) {
+  storage = std::make_shared<Storage>(std::move(pixels));
+  return *this;
+}
+
+PixelBuffer::operator std::vector<unsigned char>() const {
+  return std::vector<unsigned char>(data(), data() + size());
+}
+
+std::vector<unsigned char> PixelBuffer::release() {
+  std::vector<unsigned char> pixels;
+  if (storage.use_count() == 1 && !isMapped()) {
+    pixels = std::move(storage->owned);
+  }
+  else {
+    pixels = *this;
+  }
+  storage.reset();
+  return pixels;
+}
+
+bool PixelBuffer::map(const std::filesystem::path& filepath, size_t offset, size_t length) {
+#ifdef PIXEL_BUFFER_MMAP
+  int fd = open(filepath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  // mmap offsets must be page aligned, so the header is mapped along with the pixels
+  void* newMapping = mmap(nullptr, offset + length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (newMapping == MAP_FAILED) {
+    return false;
+  }
+
+  std::shared_ptr<Storage> mapped = std::make_shared<Storage>(std::vector<unsigned char>());
+  mapped->mapping = newMapping;
+  mapped->mappingLength = offset + length;
+  mapped->mappedPath = filepath;
+  mapped->pixels = static_cast<unsigned char*>(newMapping) + offset;
+  mapped->size = length;
+  storage = mapped;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool PixelBuffer::isMapped() const {
+  return storage && storage->mapping;
+}
+
+bool PixelBuffer::isMappedFrom(const std::filesystem::path& filepath) const {
+  std::error_code error;
+  return isMapped() && std::filesystem::equivalent(storage->mappedPath, filepath, error);
+}
+
+void PixelBuffer::detach() {
+  if (!isMapped()) {
+    return;
+  }
+  storage->owned.assign(storage->pixels, storage->pixels + storage->size);
+  storage->unmap();
+}
+
+bool PixelBuffer::isShared() const {
+  return storage.use_count() > 1;
+}
+
+bool PixelBuffer::mapWrite(const std::filesystem::path& filepath, const std::string& header, const unsigned char* pixels, size_t size) {
+#ifdef PIXEL_BUFFER_MMAP
+  size_t fileSize = header.size() + size;
+
+  int fd = open(filepath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+#ifdef __linux__
+  bool allocated = posix_fallocate(fd, 0, fileSize) == 0;
+#else
+  bool allocated = ftruncate(fd, fileSize) == 0;
+#endif
+  if (!allocated) {
+    close(fd);
+    return false;
+  }
+
+  void* output = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (output == MAP_FAILED) {
+    return false;
+  }
+
+  std::memcpy(output, header.data(), header.size());
+  std::memcpy(static_cast<unsigned char*>(output) + header.size(), pixels, size);
+  munmap(output, fileSize);
+  return true;
+#else
+  return false;
+#endif
+}
+
+size_t PixelBuffer::size() const {
+  return storage ? storage->size : 0;
+}
+void PixelBuffer::resize(size_t size) {
+  if (!storage) {
+    storage = std::make_shared<Storage>(std::vector<unsigned char>(size));
+    return;
+  }
+  makeUnique();
+  detach();
+  storage->owned.resize(size);
+  storage->pixels = storage->owned.data();
+  storage->size = size;
+}
+
+unsigned char* PixelBuffer::data() {
+  if (!storage) {
+    return nullptr;
+  }
+  makeUnique();
+  return storage->pixels;
+}
+const unsigned char* PixelBuffer::data() const {
+  return storage ? storage->pixels : nullptr;
+}
+
+unsigned char* PixelBuffer::begin() {
+  return data();
+}
+unsigned char* PixelBuffer::end() {
+  return data() + size();
+}
+
+// image view
+
+bool ImageView::empty() const {
+  return origin == nullptr || width <= 0 || height <= 0;
+}
+
+unsigned char* ImageView::row(int row) const {
+  return origin + row * stride;
+}
+
+size_t ImageView::rowSize() const {
+  return (size_t)width * numChannels * bytesPerSample;
+}
+
+bool ImageView::isContiguous() const {
+  return height <= 1 || stride == rowSize();
+}
+
+ImageView ImageView::crop(int top, int left, int cropWidth, int cropHeight) const {
+  if (top < 0 || left < 0 || cropWidth <= 0 || cropHeight <= 0 || top + cropHeight > height || left + cropWidth > width) {
+    return {};
+  }
+
+  ImageView cropped = *this;
+  cropped.origin = row(top) + (size_t)left * numChannels * bytesPerSample;
+  cropped.width = cropWidth;
+  cropped.height = cropHeight;
+  return cropped;
+}
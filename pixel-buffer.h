@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <filesystem>
+#include <memory>
+#include <cstddef>
+
+// pixel storage for PNM, either an owned vector or a read-only file mapping
+// a mapping is private so the first write to a page copies that page, the file is never modified
+// copies share the pixels until one of them asks for writable access, which copies them then
+// parallel loops that write have to get their pointer with data() before splitting into threads
+// owned pixels go back to the BufferPool when the last buffer sharing them lets go
+class PixelBuffer {
+private:
+  struct Storage {
+    std::vector<unsigned char> owned;
+
+    void* mapping = nullptr;
+    size_t mappingLength = 0;
+    std::filesystem::path mappedPath;
+
+    // owned.data() or the first pixel inside the mapping
+    unsigned char* pixels = nullptr;
+    size_t size = 0;
+
+    Storage(std::vector<unsigned char>&& pixels);
+    Storage(const Storage&) = delete;
+    ~Storage();
+
+    void unmap();
+  };
+
+  std::shared_ptr<Storage> storage;
+
+  // gives this buffer its own copy of pixels it shares with other buffers
+  void makeUnique();
+
+public:
+  PixelBuffer();
+  PixelBuffer(const std::vector<unsigned char>& pixels);
+  PixelBuffer(std::vector<unsigned char>&& pixels);
+  PixelBuffer(const PixelBuffer& other);
+  PixelBuffer(PixelBuffer&& other) noexcept;
+  ~PixelBuffer();
+
+  PixelBuffer& operator=(const PixelBuffer& other);
+  PixelBuffer& operator=(PixelBuffer&& other) noexcept;
+  PixelBuffer& operator=(const std::vector<unsigned char>& pixels);
+  PixelBuffer& operator=(std::vector<unsigned char>&& pixels);
+
+  operator std::vector<unsigned char>() const;
+  // moves the pixels out and leaves the buffer empty, only copies if they're shared or mapped
+  std::vector<unsigned char> release();
+
+  // maps length bytes of the file starting at offset, returns false if mapping isn't supported or fails
+  bool map(const std::filesystem::path& filepath, size_t offset, size_t length);
+  bool isMapped() const;
+  bool isMappedFrom(const std::filesystem::path& filepath) const;
+  // copies mapped pixels into owned memory and releases the mapping, for every buffer sharing them
+  void detach();
+  // true while another buffer shares these pixels
+  bool isShared() const;
+
+  // preallocates the file and writes header and pixels through a shared mapping, returns false if that isn't possible
+  static bool mapWrite(const std::filesystem::path& filepath, const std::string& header, const unsigned char* pixels, size_t size);
+
+  size_t size() const;
+  void resize(size_t size);
+
+  // writable access copies shared pixels first, read through a const buffer to avoid that
+  unsigned char* data();
+  const unsigned char* data() const;
+
+  unsigned char& operator[](size_t index) {
+    if (storage.use_count() > 1) {
+      makeUnique();
+    }
+    return storage->pixels[index];
+  }
+  const unsigned char& operator[](size_t index) const {
+    return storage->pixels[index];
+  }
+
+  unsigned char* begin();
+  unsigned char* end();
+};
+
+// a rectangle of an image's pixels, it doesn't own or copy them
+struct ImageView {
+  // first sample of the top left pixel
+  unsigned char* origin = nullptr;
+  int width = 0;
+  int height = 0;
+  // bytes from the start of one row to the start of the next
+  size_t stride = 0;
+  int numChannels = 1;
+  int bytesPerSample = 1;
+
+  bool empty() const;
+  unsigned char* row(int row) const;
+  // bytes of pixels in one row, stride minus any gap to the next row
+  size_t rowSize() const;
+  bool isContiguous() const;
+  // the rectangle of this view whose top left pixel is at (top, left), empty if it doesn't fit
+  ImageView crop(int top, int left, int cropWidth, int cropHeight) const;
+};
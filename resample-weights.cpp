@@ -0,0 +1,128 @@
+#include "resample-weights.h"
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+using std::vector;
+
+static double sinc(double x) {
+  if (x == 0) {
+    return 1;
+  }
+  x *= std::numbers::pi;
+  return std::sin(x) / x;
+}
+
+// filter value at distance x in source pixels, 0 past the filter's radius
+static double filterValue(const std::string& interpolation, double x) {
+  x = std::abs(x);
+
+  if (interpolation == "bilinear") {
+    return std::max(1 - x, 0.0);
+  }
+  if (interpolation == "bicubic") { // catmull-rom, a = -0.5
+    if (x < 1) {
+      return (1.5 * x - 2.5) * x * x + 1;
+    }
+    if (x < 2) {
+      return ((-0.5 * x + 2.5) * x - 4) * x + 2;
+    }
+    return 0;
+  }
+  if (interpolation == "lanczos3") {
+    return x < 3 ? sinc(x) * sinc(x / 3) : 0;
+  }
+  return 0;
+}
+
+static double filterRadius(const std::string& interpolation) {
+  if (interpolation == "bicubic") {
+    return 2;
+  }
+  if (interpolation == "lanczos3") {
+    return 3;
+  }
+  return 1;
+}
+
+ResampleWeights ResampleWeights::compute(int srcSize, int dstSize, const std::string& interpolation) {
+  double scale = (double)dstSize / srcSize;
+  bool area = interpolation == "area";
+  bool filtered = interpolation == "bilinear" || interpolation == "bicubic" || interpolation == "lanczos3";
+
+  vector<vector<double>> pixelWeights(dstSize);
+  vector<int> first(dstSize);
+
+  for (int i = 0; i < dstSize; i++) {
+    vector<double>& taps = pixelWeights[i];
+
+    if (area) {
+      // how much of each source pixel the output pixel's footprint covers
+      double left = i / scale;
+      double right = (i + 1) / scale;
+      first[i] = std::min((int)left, srcSize - 1);
+      for (int j = first[i]; j < srcSize && j < right; j++) {
+        taps.push_back(std::min(right, j + 1.0) - std::max(left, (double)j));
+      }
+    }
+    else if (filtered) {
+      // source pixel j's center is at j, taps past the edges are folded onto the edge pixels
+      double stretch = std::max(1.0, 1 / scale);
+      double support = filterRadius(interpolation) * stretch;
+      double center = (i + 0.5) / scale - 0.5;
+      int lowest = std::ceil(center - support);
+      int highest = std::floor(center + support);
+
+      first[i] = std::clamp(lowest, 0, srcSize - 1);
+      taps.assign(std::clamp(highest, 0, srcSize - 1) - first[i] + 1, 0);
+      for (int j = lowest; j <= highest; j++) {
+        taps[std::clamp(j, 0, srcSize - 1) - first[i]] += filterValue(interpolation, (j - center) / stretch);
+      }
+    }
+    else { // neighbor, the source pixel under the output pixel's center
+      first[i] = std::clamp((int)((i + 0.5) / scale), 0, srcSize - 1);
+      taps.push_back(1);
+    }
+
+    // zero weights at either end only cost time, e.g. bilinear samples landing on a pixel center
+    while (taps.size() > 1 && taps.back() == 0) {
+      taps.pop_back();
+    }
+    while (taps.size() > 1 && taps.front() == 0) {
+      taps.erase(taps.begin());
+      first[i]++;
+    }
+  }
+
+  ResampleWeights result;
+  for (const vector<double>& taps : pixelWeights) {
+    result.maxTaps = std::max(result.maxTaps, (int)taps.size());
+  }
+  result.first = first;
+  result.count.resize(dstSize);
+  result.weights.assign(dstSize * result.maxTaps, 0);
+
+  const int ONE = 1 << SHIFT;
+  for (int i = 0; i < dstSize; i++) {
+    const vector<double>& taps = pixelWeights[i];
+    double sum = 0;
+    for (double weight : taps) {
+      sum += weight;
+    }
+
+    // rounding leftovers go to the largest weight so each pixel's weights add up to exactly ONE
+    int* fixedWeights = &result.weights[i * result.maxTaps];
+    int fixedSum = 0;
+    int largest = 0;
+    for (int k = 0; k < taps.size(); k++) {
+      fixedWeights[k] = std::round(taps[k] / sum * ONE);
+      fixedSum += fixedWeights[k];
+      if (taps[k] > taps[largest]) {
+        largest = k;
+      }
+    }
+    fixedWeights[largest] += ONE - fixedSum;
+    result.count[i] = taps.size();
+  }
+  return result;
+}
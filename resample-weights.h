@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// fixed-point filter weights for resizing one axis of an image, computed once per resize
+// output pixel i reads source pixels first[i] to first[i] + count[i] - 1 with weights[i * maxTaps + k],
+// the weights of every output pixel add up to exactly 1 << SHIFT
+struct ResampleWeights {
+  static const int SHIFT = 14;
+
+  int maxTaps = 0;
+  std::vector<int> first;
+  std::vector<int> count;
+  std::vector<int> weights;
+
+  // interpolation: "neighbor", "bilinear", "bicubic", "lanczos3", "area", anything else is "neighbor"
+  // filters are widened when shrinking so every source pixel contributes
+  static ResampleWeights compute(int srcSize, int dstSize, const std::string& interpolation);
+};
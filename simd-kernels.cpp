@@ -0,0 +1,626 @@
+#include "simd-kernels.h"
+#include <algorithm>
+#include <array>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_KERNELS_X86
+#endif
+
+// luma weights in 16-bit fixed point, each set sums to 65536 so white stays white
+const int LUMA_SHIFT = 16;
+const int LUMA_709[3] = {13933, 46871, 4732};
+const int LUMA_601[3] = {19595, 38470, 7471};
+// (r + g + b) / 3 is exact as (r + g + b) * 43691 >> 17 for sums up to 765
+const int AVERAGE_SHIFT = 17;
+const int AVERAGE[3] = {43691, 43691, 43691};
+
+// sepia scales the 709 luma by these, also 16-bit fixed point
+const int SEPIA[3] = {57569, 33925, 10280};
+
+static void grayscaleWeights(int standard, const int*& weights, int& shift) {
+  if (standard == 709) {
+    weights = LUMA_709;
+    shift = LUMA_SHIFT;
+  }
+  else if (standard == 601) {
+    weights = LUMA_601;
+    shift = LUMA_SHIFT;
+  }
+  else {
+    weights = AVERAGE;
+    shift = AVERAGE_SHIFT;
+  }
+}
+
+static constexpr int channelAfterSwap(int channel, int channelOffset1, int channelOffset2) {
+  if (channel == channelOffset1) {
+    return channelOffset2;
+  }
+  if (channel == channelOffset2) {
+    return channelOffset1;
+  }
+  return channel;
+}
+
+
+// scalar
+
+static void grayscaleScalar(const unsigned char* src, unsigned char* dst, int numPixels, int standard) {
+  const int* weights;
+  int shift;
+  grayscaleWeights(standard, weights, shift);
+
+  for (int pixel = 0; pixel < numPixels; pixel++) {
+    const unsigned char* rgb = src + pixel * 3;
+    dst[pixel] = (rgb[0] * weights[0] + rgb[1] * weights[1] + rgb[2] * weights[2]) >> shift;
+  }
+}
+
+static void invertScalar(unsigned char* samples, int numSamples, int maxColor) {
+  for (int i = 0; i < numSamples; i++) {
+    samples[i] = maxColor - samples[i];
+  }
+}
+
+static void sepiaScalar(unsigned char* pixels, int numPixels) {
+  for (int i = 0; i < numPixels * 3; i += 3) {
+    int gray = (pixels[i] * LUMA_709[0] + pixels[i + 1] * LUMA_709[1] + pixels[i + 2] * LUMA_709[2]) >> LUMA_SHIFT;
+
+    pixels[i] = (gray * SEPIA[0]) >> 16;
+    pixels[i + 1] = (gray * SEPIA[1]) >> 16;
+    pixels[i + 2] = (gray * SEPIA[2]) >> 16;
+  }
+}
+
+static void tintScalar(unsigned char* pixels, int numPixels, float r, float g, float b, float brightness) {
+  const float factors[3] = {r, g, b};
+
+  for (int i = 0; i < numPixels * 3; i++) {
+    float tinted = pixels[i] * factors[i % 3] * brightness;
+    pixels[i] = std::clamp(tinted, 0.0f, 255.0f);
+  }
+}
+
+static void thresholdScalar(unsigned char* samples, int numSamples, int epsilon) {
+  for (int i = 0; i < numSamples; i++) {
+    samples[i] = samples[i] > epsilon ? 255 : 0;
+  }
+}
+
+static void channelSwapScalar(unsigned char* pixels, int numPixels, int channelOffset1, int channelOffset2) {
+  unsigned char temp;
+  for (int i = 0; i < numPixels * 3; i += 3) {
+    temp = pixels[i + channelOffset1];
+    pixels[i + channelOffset1] = pixels[i + channelOffset2];
+    pixels[i + channelOffset2] = temp;
+  }
+}
+
+static void reverseScalar(unsigned char* pixels, int numPixels, int numChannels) {
+  if (numChannels == 3) {
+    std::array<unsigned char, 3>* rgb = reinterpret_cast<std::array<unsigned char, 3>*>(pixels);
+    std::reverse(rgb, rgb + numPixels);
+  }
+  else {
+    std::reverse(pixels, pixels + numPixels);
+  }
+}
+
+static const PixelKernels SCALAR_KERNELS = {
+  grayscaleScalar, invertScalar, sepiaScalar, tintScalar, thresholdScalar, channelSwapScalar, reverseScalar
+};
+
+
+#ifdef SIMD_KERNELS_X86
+
+// shuffle masks for 16 RGB pixels spread over three 16-byte vectors
+
+struct ShuffleMasks {
+  // deinterleave[channel][block] gathers one channel of the 16 pixels out of that block
+  alignas(16) unsigned char deinterleave[3][3][16];
+  // interleave[block][channel] scatters a 16-byte channel back into that output block
+  alignas(16) unsigned char interleave[3][3][16];
+};
+
+// masks are built at compile time so kernels called during static initialization still see them
+static constexpr ShuffleMasks buildShuffleMasks() {
+  ShuffleMasks masks = {};
+
+  for (int channel = 0; channel < 3; channel++) {
+    for (int block = 0; block < 3; block++) {
+      for (int i = 0; i < 16; i++) {
+        int source = 3 * i + channel;
+        masks.deinterleave[channel][block][i] = source / 16 == block ? source % 16 : 0x80;
+
+        int output = 16 * block + i;
+        masks.interleave[block][channel][i] = output % 3 == channel ? output / 3 : 0x80;
+      }
+    }
+  }
+  return masks;
+}
+
+static constexpr ShuffleMasks SHUFFLE_MASKS = buildShuffleMasks();
+
+// swap[outBlock][inBlock] for one pair of channels
+struct SwapMasks {
+  alignas(16) unsigned char swap[3][3][16];
+};
+
+static constexpr SwapMasks buildSwapMasks(int channelOffset1, int channelOffset2) {
+  SwapMasks masks = {};
+
+  for (int outBlock = 0; outBlock < 3; outBlock++) {
+    for (int inBlock = 0; inBlock < 3; inBlock++) {
+      for (int i = 0; i < 16; i++) {
+        int output = 16 * outBlock + i;
+        int source = (output / 3) * 3 + channelAfterSwap(output % 3, channelOffset1, channelOffset2);
+        masks.swap[outBlock][inBlock][i] = source / 16 == inBlock ? source % 16 : 0x80;
+      }
+    }
+  }
+  return masks;
+}
+
+static constexpr std::array<SwapMasks, 3> SWAP_MASKS = {buildSwapMasks(0, 1), buildSwapMasks(0, 2), buildSwapMasks(1, 2)};
+
+// reverse[outBlock][inBlock] puts 16 RGB pixels in the opposite order, same layout as the swap masks
+static constexpr SwapMasks buildReverseMasks() {
+  SwapMasks masks = {};
+
+  for (int outBlock = 0; outBlock < 3; outBlock++) {
+    for (int inBlock = 0; inBlock < 3; inBlock++) {
+      for (int i = 0; i < 16; i++) {
+        int output = 16 * outBlock + i;
+        int source = (15 - output / 3) * 3 + output % 3;
+        masks.swap[outBlock][inBlock][i] = source / 16 == inBlock ? source % 16 : 0x80;
+      }
+    }
+  }
+  return masks;
+}
+
+static constexpr SwapMasks REVERSE_MASKS = buildReverseMasks();
+
+static const SwapMasks* swapMasksFor(int channelOffset1, int channelOffset2) {
+  int low = std::min(channelOffset1, channelOffset2);
+  int high = std::max(channelOffset1, channelOffset2);
+
+  if (low == 0 && high == 1) {
+    return &SWAP_MASKS[0];
+  }
+  if (low == 0 && high == 2) {
+    return &SWAP_MASKS[1];
+  }
+  if (low == 1 && high == 2) {
+    return &SWAP_MASKS[2];
+  }
+  return nullptr;
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i loadMask(const unsigned char* mask) {
+  return _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i gatherChannel(__m128i a, __m128i b, __m128i c, int channel) {
+  const ShuffleMasks& masks = SHUFFLE_MASKS;
+  return _mm_or_si128(_mm_or_si128(
+    _mm_shuffle_epi8(a, loadMask(masks.deinterleave[channel][0])),
+    _mm_shuffle_epi8(b, loadMask(masks.deinterleave[channel][1]))),
+    _mm_shuffle_epi8(c, loadMask(masks.deinterleave[channel][2])));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i scatterBlock(__m128i r, __m128i g, __m128i b, int block) {
+  const ShuffleMasks& masks = SHUFFLE_MASKS;
+  return _mm_or_si128(_mm_or_si128(
+    _mm_shuffle_epi8(r, loadMask(masks.interleave[block][0])),
+    _mm_shuffle_epi8(g, loadMask(masks.interleave[block][1]))),
+    _mm_shuffle_epi8(b, loadMask(masks.interleave[block][2])));
+}
+
+// 4 lanes of (r * w0 + g * w1 + b * w2) >> shift from bytes [OFFSET, OFFSET + 4) of each channel
+template <int OFFSET>
+__attribute__((target("sse4.1")))
+static inline __m128i weightedSum4(__m128i r, __m128i g, __m128i b, const int* weights, __m128i shift) {
+  __m128i r32 = _mm_cvtepu8_epi32(_mm_srli_si128(r, OFFSET));
+  __m128i g32 = _mm_cvtepu8_epi32(_mm_srli_si128(g, OFFSET));
+  __m128i b32 = _mm_cvtepu8_epi32(_mm_srli_si128(b, OFFSET));
+
+  __m128i sum = _mm_add_epi32(_mm_add_epi32(
+    _mm_mullo_epi32(r32, _mm_set1_epi32(weights[0])),
+    _mm_mullo_epi32(g32, _mm_set1_epi32(weights[1]))),
+    _mm_mullo_epi32(b32, _mm_set1_epi32(weights[2])));
+  return _mm_srl_epi32(sum, shift);
+}
+
+// 16 bytes of (r * w0 + g * w1 + b * w2) >> shift
+__attribute__((target("sse4.1")))
+static inline __m128i weightedSum16(__m128i r, __m128i g, __m128i b, const int* weights, __m128i shift) {
+  __m128i low = _mm_packus_epi32(weightedSum4<0>(r, g, b, weights, shift), weightedSum4<4>(r, g, b, weights, shift));
+  __m128i high = _mm_packus_epi32(weightedSum4<8>(r, g, b, weights, shift), weightedSum4<12>(r, g, b, weights, shift));
+  return _mm_packus_epi16(low, high);
+}
+
+// scales a single 16-byte channel by a 16-bit fixed point factor
+__attribute__((target("sse4.1")))
+static inline __m128i scale16(__m128i gray, int factor) {
+  __m128i low = _mm_unpacklo_epi8(gray, _mm_setzero_si128());
+  __m128i high = _mm_unpackhi_epi8(gray, _mm_setzero_si128());
+  __m128i scale = _mm_set1_epi16(static_cast<short>(factor));
+  return _mm_packus_epi16(_mm_mulhi_epu16(low, scale), _mm_mulhi_epu16(high, scale));
+}
+
+
+// sse4.1
+
+__attribute__((target("sse4.1")))
+static void grayscaleSSE41(const unsigned char* src, unsigned char* dst, int numPixels, int standard) {
+  const int* weights;
+  int shift;
+  grayscaleWeights(standard, weights, shift);
+  __m128i shiftCount = _mm_cvtsi32_si128(shift);
+
+  int pixel = 0;
+  for (; pixel + 16 <= numPixels; pixel += 16) {
+    const __m128i* in = reinterpret_cast<const __m128i*>(src + pixel * 3);
+    __m128i a = _mm_loadu_si128(in);
+    __m128i b = _mm_loadu_si128(in + 1);
+    __m128i c = _mm_loadu_si128(in + 2);
+
+    __m128i gray = weightedSum16(gatherChannel(a, b, c, 0), gatherChannel(a, b, c, 1), gatherChannel(a, b, c, 2), weights, shiftCount);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pixel), gray);
+  }
+  grayscaleScalar(src + pixel * 3, dst + pixel, numPixels - pixel, standard);
+}
+
+__attribute__((target("sse4.1")))
+static void invertSSE41(unsigned char* samples, int numSamples, int maxColor) {
+  __m128i maxValue = _mm_set1_epi8(static_cast<char>(maxColor));
+
+  int i = 0;
+  for (; i + 16 <= numSamples; i += 16) {
+    __m128i* block = reinterpret_cast<__m128i*>(samples + i);
+    _mm_storeu_si128(block, _mm_sub_epi8(maxValue, _mm_loadu_si128(block)));
+  }
+  invertScalar(samples + i, numSamples - i, maxColor);
+}
+
+__attribute__((target("sse4.1")))
+static void sepiaSSE41(unsigned char* pixels, int numPixels) {
+  __m128i shiftCount = _mm_cvtsi32_si128(LUMA_SHIFT);
+
+  int pixel = 0;
+  for (; pixel + 16 <= numPixels; pixel += 16) {
+    __m128i* block = reinterpret_cast<__m128i*>(pixels + pixel * 3);
+    __m128i a = _mm_loadu_si128(block);
+    __m128i b = _mm_loadu_si128(block + 1);
+    __m128i c = _mm_loadu_si128(block + 2);
+
+    __m128i gray = weightedSum16(gatherChannel(a, b, c, 0), gatherChannel(a, b, c, 1), gatherChannel(a, b, c, 2), LUMA_709, shiftCount);
+    __m128i r = scale16(gray, SEPIA[0]);
+    __m128i g = scale16(gray, SEPIA[1]);
+    __m128i bl = scale16(gray, SEPIA[2]);
+
+    _mm_storeu_si128(block, scatterBlock(r, g, bl, 0));
+    _mm_storeu_si128(block + 1, scatterBlock(r, g, bl, 1));
+    _mm_storeu_si128(block + 2, scatterBlock(r, g, bl, 2));
+  }
+  sepiaScalar(pixels + pixel * 3, numPixels - pixel);
+}
+
+// 4 samples from byte OFFSET times a per-lane factor then brightness, same float operations as the scalar path
+template <int OFFSET>
+__attribute__((target("sse4.1")))
+static inline __m128i tint4(__m128i samples, __m128 factors, __m128 brightness) {
+  __m128 values = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(samples, OFFSET)));
+  values = _mm_mul_ps(_mm_mul_ps(values, factors), brightness);
+  values = _mm_max_ps(_mm_min_ps(values, _mm_set1_ps(255.0f)), _mm_setzero_ps());
+  return _mm_cvttps_epi32(values);
+}
+
+__attribute__((target("sse4.1")))
+static void tintSSE41(unsigned char* pixels, int numPixels, float r, float g, float b, float brightness) {
+  // 48 bytes of RGB are 12 groups of 4 samples, the factor pattern repeats every 3 groups
+  const __m128 factors[3] = {_mm_setr_ps(r, g, b, r), _mm_setr_ps(g, b, r, g), _mm_setr_ps(b, r, g, b)};
+  __m128 brightnessVector = _mm_set1_ps(brightness);
+
+  int pixel = 0;
+  for (; pixel + 16 <= numPixels; pixel += 16) {
+    __m128i* block = reinterpret_cast<__m128i*>(pixels + pixel * 3);
+
+    for (int part = 0; part < 3; part++) {
+      __m128i samples = _mm_loadu_si128(block + part);
+      int group = part * 4;
+
+      __m128i low = _mm_packus_epi32(tint4<0>(samples, factors[group % 3], brightnessVector), tint4<4>(samples, factors[(group + 1) % 3], brightnessVector));
+      __m128i high = _mm_packus_epi32(tint4<8>(samples, factors[(group + 2) % 3], brightnessVector), tint4<12>(samples, factors[(group + 3) % 3], brightnessVector));
+      _mm_storeu_si128(block + part, _mm_packus_epi16(low, high));
+    }
+  }
+  tintScalar(pixels + pixel * 3, numPixels - pixel, r, g, b, brightness);
+}
+
+__attribute__((target("sse4.1")))
+static void thresholdSSE41(unsigned char* samples, int numSamples, int epsilon) {
+  if (epsilon < 0 || epsilon >= 255) {
+    thresholdScalar(samples, numSamples, epsilon);
+    return;
+  }
+
+  // x > epsilon exactly when max(x, epsilon + 1) == x
+  __m128i bound = _mm_set1_epi8(static_cast<char>(epsilon + 1));
+
+  int i = 0;
+  for (; i + 16 <= numSamples; i += 16) {
+    __m128i* block = reinterpret_cast<__m128i*>(samples + i);
+    __m128i values = _mm_loadu_si128(block);
+    _mm_storeu_si128(block, _mm_cmpeq_epi8(_mm_max_epu8(values, bound), values));
+  }
+  thresholdScalar(samples + i, numSamples - i, epsilon);
+}
+
+__attribute__((target("sse4.1")))
+static void channelSwapSSE41(unsigned char* pixels, int numPixels, int channelOffset1, int channelOffset2) {
+  const SwapMasks* masks = swapMasksFor(channelOffset1, channelOffset2);
+  if (!masks) { // swapping a channel with itself
+    return;
+  }
+
+  int pixel = 0;
+  for (; pixel + 16 <= numPixels; pixel += 16) {
+    __m128i* block = reinterpret_cast<__m128i*>(pixels + pixel * 3);
+    __m128i in[3] = {_mm_loadu_si128(block), _mm_loadu_si128(block + 1), _mm_loadu_si128(block + 2)};
+
+    for (int outBlock = 0; outBlock < 3; outBlock++) {
+      __m128i out = _mm_setzero_si128();
+      for (int inBlock = 0; inBlock < 3; inBlock++) {
+        out = _mm_or_si128(out, _mm_shuffle_epi8(in[inBlock], loadMask(masks->swap[outBlock][inBlock])));
+      }
+      _mm_storeu_si128(block + outBlock, out);
+    }
+  }
+  channelSwapScalar(pixels + pixel * 3, numPixels - pixel, channelOffset1, channelOffset2);
+}
+
+// loads 16 pixels and puts them in reverse order, one vector for gray or three for RGB
+__attribute__((target("sse4.1")))
+static inline void loadReversed16(const unsigned char* pixels, int numChannels, __m128i out[3]) {
+  const __m128i* block = reinterpret_cast<const __m128i*>(pixels);
+  if (numChannels == 1) {
+    out[0] = _mm_shuffle_epi8(_mm_loadu_si128(block), _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+    return;
+  }
+
+  __m128i in[3] = {_mm_loadu_si128(block), _mm_loadu_si128(block + 1), _mm_loadu_si128(block + 2)};
+  for (int outBlock = 0; outBlock < 3; outBlock++) {
+    out[outBlock] = _mm_setzero_si128();
+    for (int inBlock = 0; inBlock < 3; inBlock++) {
+      out[outBlock] = _mm_or_si128(out[outBlock], _mm_shuffle_epi8(in[inBlock], loadMask(REVERSE_MASKS.swap[outBlock][inBlock])));
+    }
+  }
+}
+
+// swaps reversed 16 pixel blocks from both ends towards the middle
+__attribute__((target("sse4.1")))
+static void reverseSSE41(unsigned char* pixels, int numPixels, int numChannels) {
+  int left = 0;
+  int right = numPixels;
+  while (right - left >= 32) {
+    unsigned char* leftBlock = pixels + left * numChannels;
+    unsigned char* rightBlock = pixels + (right - 16) * numChannels;
+
+    __m128i leftReversed[3];
+    __m128i rightReversed[3];
+    loadReversed16(leftBlock, numChannels, leftReversed);
+    loadReversed16(rightBlock, numChannels, rightReversed);
+
+    for (int i = 0; i < numChannels; i++) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(leftBlock) + i, rightReversed[i]);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(rightBlock) + i, leftReversed[i]);
+    }
+    left += 16;
+    right -= 16;
+  }
+  reverseScalar(pixels + left * numChannels, right - left, numChannels);
+}
+
+static const PixelKernels SSE41_KERNELS = {
+  grayscaleSSE41, invertSSE41, sepiaSSE41, tintSSE41, thresholdSSE41, channelSwapSSE41, reverseSSE41
+};
+
+
+// avx2, 32 samples per step for byte kernels, 8 lanes of 32-bit math for weighted sums
+
+__attribute__((target("avx2")))
+static inline __m128i weightedSum16AVX2(__m128i r, __m128i g, __m128i b, const int* weights, __m128i shift) {
+  __m256i wr = _mm256_set1_epi32(weights[0]);
+  __m256i wg = _mm256_set1_epi32(weights[1]);
+  __m256i wb = _mm256_set1_epi32(weights[2]);
+
+  __m256i low = _mm256_add_epi32(_mm256_add_epi32(
+    _mm256_mullo_epi32(_mm256_cvtepu8_epi32(r), wr),
+    _mm256_mullo_epi32(_mm256_cvtepu8_epi32(g), wg)),
+    _mm256_mullo_epi32(_mm256_cvtepu8_epi32(b), wb));
+  __m256i high = _mm256_add_epi32(_mm256_add_epi32(
+    _mm256_mullo_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(r, 8)), wr),
+    _mm256_mullo_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(g, 8)), wg)),
+    _mm256_mullo_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(b, 8)), wb));
+
+  low = _mm256_srl_epi32(low, shift);
+  high = _mm256_srl_epi32(high, shift);
+
+  // packus works within 128-bit lanes, the permute puts the 16 results back in order
+  __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(low, high), 0xD8);
+  return _mm_packus_epi16(_mm256_castsi256_si128(packed), _mm256_extracti128_si256(packed, 1));
+}
+
+__attribute__((target("avx2")))
+static void grayscaleAVX2(const unsigned char* src, unsigned char* dst, int numPixels, int standard) {
+  const int* weights;
+  int shift;
+  grayscaleWeights(standard, weights, shift);
+  __m128i shiftCount = _mm_cvtsi32_si128(shift);
+
+  int pixel = 0;
+  for (; pixel + 16 <= numPixels; pixel += 16) {
+    const __m128i* in = reinterpret_cast<const __m128i*>(src + pixel * 3);
+    __m128i a = _mm_loadu_si128(in);
+    __m128i b = _mm_loadu_si128(in + 1);
+    __m128i c = _mm_loadu_si128(in + 2);
+
+    __m128i gray = weightedSum16AVX2(gatherChannel(a, b, c, 0), gatherChannel(a, b, c, 1), gatherChannel(a, b, c, 2), weights, shiftCount);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pixel), gray);
+  }
+  grayscaleScalar(src + pixel * 3, dst + pixel, numPixels - pixel, standard);
+}
+
+__attribute__((target("avx2")))
+static void invertAVX2(unsigned char* samples, int numSamples, int maxColor) {
+  __m256i maxValue = _mm256_set1_epi8(static_cast<char>(maxColor));
+
+  int i = 0;
+  for (; i + 32 <= numSamples; i += 32) {
+    __m256i* block = reinterpret_cast<__m256i*>(samples + i);
+    _mm256_storeu_si256(block, _mm256_sub_epi8(maxValue, _mm256_loadu_si256(block)));
+  }
+  invertScalar(samples + i, numSamples - i, maxColor);
+}
+
+__attribute__((target("avx2")))
+static void sepiaAVX2(unsigned char* pixels, int numPixels) {
+  __m128i shiftCount = _mm_cvtsi32_si128(LUMA_SHIFT);
+
+  int pixel = 0;
+  for (; pixel + 16 <= numPixels; pixel += 16) {
+    __m128i* block = reinterpret_cast<__m128i*>(pixels + pixel * 3);
+    __m128i a = _mm_loadu_si128(block);
+    __m128i b = _mm_loadu_si128(block + 1);
+    __m128i c = _mm_loadu_si128(block + 2);
+
+    __m128i gray = weightedSum16AVX2(gatherChannel(a, b, c, 0), gatherChannel(a, b, c, 1), gatherChannel(a, b, c, 2), LUMA_709, shiftCount);
+    __m128i r = scale16(gray, SEPIA[0]);
+    __m128i g = scale16(gray, SEPIA[1]);
+    __m128i bl = scale16(gray, SEPIA[2]);
+
+    _mm_storeu_si128(block, scatterBlock(r, g, bl, 0));
+    _mm_storeu_si128(block + 1, scatterBlock(r, g, bl, 1));
+    _mm_storeu_si128(block + 2, scatterBlock(r, g, bl, 2));
+  }
+  sepiaScalar(pixels + pixel * 3, numPixels - pixel);
+}
+
+__attribute__((target("avx2")))
+static void tintAVX2(unsigned char* pixels, int numPixels, float r, float g, float b, float brightness) {
+  // 48 bytes of RGB are 6 groups of 8 samples, the factor pattern repeats every 3 groups
+  const __m256 factors[3] = {
+    _mm256_setr_ps(r, g, b, r, g, b, r, g),
+    _mm256_setr_ps(b, r, g, b, r, g, b, r),
+    _mm256_setr_ps(g, b, r, g, b, r, g, b)
+  };
+  __m256 brightnessVector = _mm256_set1_ps(brightness);
+  __m256 maxValue = _mm256_set1_ps(255.0f);
+  __m256 minValue = _mm256_setzero_ps();
+
+  int pixel = 0;
+  for (; pixel + 16 <= numPixels; pixel += 16) {
+    unsigned char* block = pixels + pixel * 3;
+
+    for (int group = 0; group < 6; group += 2) {
+      __m128i samples = _mm_loadu_si128(reinterpret_cast<__m128i*>(block + group * 8));
+
+      __m256 low = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(samples));
+      __m256 high = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(samples, 8)));
+      low = _mm256_mul_ps(_mm256_mul_ps(low, factors[group % 3]), brightnessVector);
+      high = _mm256_mul_ps(_mm256_mul_ps(high, factors[(group + 1) % 3]), brightnessVector);
+      low = _mm256_max_ps(_mm256_min_ps(low, maxValue), minValue);
+      high = _mm256_max_ps(_mm256_min_ps(high, maxValue), minValue);
+
+      __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(_mm256_cvttps_epi32(low), _mm256_cvttps_epi32(high)), 0xD8);
+      __m128i tinted = _mm_packus_epi16(_mm256_castsi256_si128(packed), _mm256_extracti128_si256(packed, 1));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(block + group * 8), tinted);
+    }
+  }
+  tintScalar(pixels + pixel * 3, numPixels - pixel, r, g, b, brightness);
+}
+
+__attribute__((target("avx2")))
+static void thresholdAVX2(unsigned char* samples, int numSamples, int epsilon) {
+  if (epsilon < 0 || epsilon >= 255) {
+    thresholdScalar(samples, numSamples, epsilon);
+    return;
+  }
+
+  __m256i bound = _mm256_set1_epi8(static_cast<char>(epsilon + 1));
+
+  int i = 0;
+  for (; i + 32 <= numSamples; i += 32) {
+    __m256i* block = reinterpret_cast<__m256i*>(samples + i);
+    __m256i values = _mm256_loadu_si256(block);
+    _mm256_storeu_si256(block, _mm256_cmpeq_epi8(_mm256_max_epu8(values, bound), values));
+  }
+  thresholdScalar(samples + i, numSamples - i, epsilon);
+}
+
+// the 128-bit swap is already shuffle bound, the avx2 table reuses it
+static const PixelKernels AVX2_KERNELS = {
+  grayscaleAVX2, invertAVX2, sepiaAVX2, tintAVX2, thresholdAVX2, channelSwapSSE41, reverseSSE41
+};
+
+#endif
+
+
+// scalar until the CPU has been checked, every level gives the same results so early callers are unaffected
+SimdLevel SimdKernels::level = SimdLevel::SCALAR;
+const PixelKernels* SimdKernels::active = &SCALAR_KERNELS;
+static const bool DETECTED = (SimdKernels::setLevel(SimdKernels::detectLevel()), true);
+
+SimdLevel SimdKernels::detectLevel() {
+#ifdef SIMD_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::AVX2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return SimdLevel::SSE41;
+  }
+#endif
+  return SimdLevel::SCALAR;
+}
+
+void SimdKernels::setLevel(SimdLevel level) {
+  SimdKernels::level = std::min(level, detectLevel());
+  active = &get(SimdKernels::level);
+}
+SimdLevel SimdKernels::getLevel() {
+  return level;
+}
+
+std::string SimdKernels::levelName(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::AVX2:
+      return "avx2";
+    case SimdLevel::SSE41:
+      return "sse4.1";
+    default:
+      return "scalar";
+  }
+}
+
+const PixelKernels& SimdKernels::get() {
+  return *active;
+}
+const PixelKernels& SimdKernels::get(SimdLevel level) {
+#ifdef SIMD_KERNELS_X86
+  if (level == SimdLevel::AVX2) {
+    return AVX2_KERNELS;
+  }
+  if (level == SimdLevel::SSE41) {
+    return SSE41_KERNELS;
+  }
+#endif
+  return SCALAR_KERNELS;
+}
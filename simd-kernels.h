@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+enum class SimdLevel { SCALAR, SSE41, AVX2 };
+
+// per-pixel color kernels, every variant gives bit-identical results to the scalar one
+struct PixelKernels {
+  // 3-channel src to 1-channel dst, dst may alias src
+  void (*grayscale)(const unsigned char* src, unsigned char* dst, int numPixels, int standard);
+  void (*invert)(unsigned char* samples, int numSamples, int maxColor);
+  void (*sepia)(unsigned char* pixels, int numPixels);
+  // r, g and b are already normalized to 0-1
+  void (*tint)(unsigned char* pixels, int numPixels, float r, float g, float b, float brightness);
+  void (*threshold)(unsigned char* samples, int numSamples, int epsilon);
+  void (*channelSwap)(unsigned char* pixels, int numPixels, int channelOffset1, int channelOffset2);
+  // reverses the order of 1 or 3 channel pixels in place
+  void (*reverse)(unsigned char* pixels, int numPixels, int numChannels);
+};
+
+// picks the widest kernels the CPU supports the first time they're used
+class SimdKernels {
+private:
+  static SimdLevel level;
+  static const PixelKernels* active;
+
+public:
+  static SimdLevel detectLevel();
+  // levels above detectLevel() are lowered to it
+  static void setLevel(SimdLevel level);
+  static SimdLevel getLevel();
+  static std::string levelName(SimdLevel level);
+
+  static const PixelKernels& get();
+  static const PixelKernels& get(SimdLevel level);
+};
@@ -0,0 +1,243 @@
+#include "staged-batch.h"
+#include "bounded-queue.h"
+#include <chrono>
+#include <thread>
+
+using std::vector;
+using std::string;
+using std::filesystem::path;
+
+void MemoryBudget::acquire(size_t bytes) {
+  std::unique_lock<std::mutex> lock(mutex);
+  released.wait(lock, [&] { return inUse == 0 || inUse + bytes <= capacity; });
+  inUse += bytes;
+}
+
+void MemoryBudget::release(size_t bytes) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    inUse -= bytes;
+  }
+  released.notify_all();
+}
+
+double StagedBatch::StageStats::busy(double wallSeconds) const {
+  return threads > 0 && wallSeconds > 0 ? busySeconds / (threads * wallSeconds) : 0;
+}
+
+double StagedBatch::StageStats::starved(double wallSeconds) const {
+  return threads > 0 && wallSeconds > 0 ? starvedSeconds / (threads * wallSeconds) : 0;
+}
+
+double StagedBatch::StageStats::blocked(double wallSeconds) const {
+  return threads > 0 && wallSeconds > 0 ? blockedSeconds / (threads * wallSeconds) : 0;
+}
+
+// each thread's time, added to its stage's totals as it goes
+struct StageCounters {
+  std::atomic<long long> busy{0};
+  std::atomic<long long> starved{0};
+  std::atomic<long long> blocked{0};
+  std::atomic<int> files{0};
+};
+
+// charges the time since the last lap to one of a stage's counters
+class StageClock {
+private:
+  std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+
+public:
+  void lap(std::atomic<long long>& counter) {
+    auto now = std::chrono::steady_clock::now();
+    counter += std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+    last = now;
+  }
+};
+
+// an image on its way between stages
+struct BatchItem {
+  int fileIndex = -1;
+  PNM* img = nullptr;
+  size_t bytes = 0;
+};
+
+StagedBatch::StagedBatch(const Options& options) {
+  this->options = options;
+  this->options.readers = std::max(this->options.readers, 1);
+  this->options.workers = std::max(this->options.workers, 1);
+  this->options.writers = std::max(this->options.writers, 1);
+  this->options.queueDepth = std::max(this->options.queueDepth, 1);
+}
+
+vector<StagedBatch::FileResult> StagedBatch::run(const vector<path>& files, const path& outputDir, Pipeline& pipeline) {
+  vector<FileResult> results(files.size());
+  for (int i = 0; i < files.size(); i++) {
+    results[i].file = files[i];
+  }
+
+  // enough images for every thread to hold one and every queue to be full, more would only sit in the free list
+  int numImages = options.readers + options.workers + options.writers + 2 * options.queueDepth;
+  vector<PNM> images(numImages);
+  BoundedQueue<PNM*> freeImages(numImages);
+  for (PNM& img : images) {
+    freeImages.push(&img);
+  }
+  BoundedQueue<BatchItem> toProcess(options.queueDepth);
+  BoundedQueue<BatchItem> toWrite(options.queueDepth);
+
+  MemoryBudget budget(options.memoryLimit);
+  StageCounters reading, processing, writing;
+  std::atomic<int> nextFile{0};
+  std::atomic<int> readersLeft{options.readers};
+  std::atomic<int> workersLeft{options.workers};
+
+  // the image goes back for another file to be read into
+  auto finish = [&](const BatchItem& item, const string& error) {
+    if (!error.empty()) {
+      results[item.fileIndex].error = error;
+    }
+    else {
+      results[item.fileIndex].succeeded = true;
+    }
+    budget.release(item.bytes);
+    freeImages.push(item.img);
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  vector<std::thread> threads;
+
+  for (int i = 0; i < options.readers; i++) {
+    threads.emplace_back([&] {
+      StageClock clock;
+      int fileIndex;
+      while ((fileIndex = nextFile.fetch_add(1)) < files.size()) {
+        std::error_code fileError;
+        BatchItem item;
+        item.fileIndex = fileIndex;
+        item.bytes = std::filesystem::file_size(files[fileIndex], fileError) * WORKING_COPIES;
+
+        freeImages.pop(item.img);
+        budget.acquire(item.bytes);
+        clock.lap(reading.blocked);
+
+        string error;
+        try {
+          if (!item.img->read(files[fileIndex])) {
+            error = "failed to read";
+          }
+          results[fileIndex].pixels = (long long)item.img->getWidth() * item.img->getHeight();
+        }
+        catch (const std::exception& e) {
+          error = e.what();
+        }
+        reading.files++;
+        clock.lap(reading.busy);
+
+        if (!error.empty()) {
+          finish(item, error);
+          continue;
+        }
+        toProcess.push(item);
+        clock.lap(reading.blocked);
+      }
+      if (--readersLeft == 0) {
+        toProcess.close();
+      }
+    });
+  }
+
+  for (int i = 0; i < options.workers; i++) {
+    threads.emplace_back([&] {
+      StageClock clock;
+      BatchItem item;
+      while (toProcess.pop(item)) {
+        clock.lap(processing.starved);
+
+        string error;
+        try {
+          pipeline.run(*item.img);
+        }
+        catch (const std::exception& e) {
+          error = e.what();
+        }
+        processing.files++;
+        clock.lap(processing.busy);
+
+        if (!error.empty()) {
+          finish(item, error);
+          continue;
+        }
+        toWrite.push(item);
+        clock.lap(processing.blocked);
+      }
+      clock.lap(processing.starved);
+      if (--workersLeft == 0) {
+        toWrite.close();
+      }
+    });
+  }
+
+  for (int i = 0; i < options.writers; i++) {
+    threads.emplace_back([&] {
+      StageClock clock;
+      BatchItem item;
+      while (toWrite.pop(item)) {
+        clock.lap(writing.starved);
+
+        string error;
+        try {
+          if (!item.img->write(outputDir / files[item.fileIndex].filename())) {
+            error = "failed to write";
+          }
+        }
+        catch (const std::exception& e) {
+          error = e.what();
+        }
+        writing.files++;
+        clock.lap(writing.busy);
+
+        finish(item, error);
+      }
+      clock.lap(writing.starved);
+    });
+  }
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  auto summarize = [](const string& name, int threads, const StageCounters& counters) {
+    StageStats stage;
+    stage.name = name;
+    stage.threads = threads;
+    stage.files = counters.files;
+    stage.busySeconds = counters.busy / 1e9;
+    stage.starvedSeconds = counters.starved / 1e9;
+    stage.blockedSeconds = counters.blocked / 1e9;
+    return stage;
+  };
+  stats = {summarize("read", options.readers, reading),
+           summarize("process", options.workers, processing),
+           summarize("write", options.writers, writing)};
+
+  return results;
+}
+
+const vector<StagedBatch::StageStats>& StagedBatch::getStats() const {
+  return stats;
+}
+
+double StagedBatch::getWallSeconds() const {
+  return wallSeconds;
+}
+
+const StagedBatch::StageStats& StagedBatch::bottleneck() const {
+  int busiest = 0;
+  for (int i = 1; i < stats.size(); i++) {
+    if (stats[i].busy(wallSeconds) > stats[busiest].busy(wallSeconds)) {
+      busiest = i;
+    }
+  }
+  return stats[busiest];
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "image-processor.h"
+#include "pipeline.h"
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// limits how many bytes of images are being worked on at once
+class MemoryBudget {
+private:
+  size_t capacity;
+  size_t inUse = 0;
+  std::mutex mutex;
+  std::condition_variable released;
+
+public:
+  MemoryBudget(size_t capacity) : capacity(capacity) {}
+
+  // an image bigger than the whole budget still runs once nothing else is in flight
+  void acquire(size_t bytes);
+  void release(size_t bytes);
+};
+
+// runs a pipeline over a list of files in three overlapping stages, readers load the next files while
+// workers filter and writers save earlier ones, so the disk and the cpus are busy at the same time
+// stages hand images on through bounded queues, a stage that gets ahead waits for room downstream
+// a fixed set of PNM objects goes round the stages, each file is read into one an earlier file left, reusing
+// its pixel buffer
+class StagedBatch {
+public:
+  // a file needs about three times its size while being filtered, the image plus a filter's temporaries
+  static const int WORKING_COPIES = 3;
+
+  struct Options {
+    int readers = 1;
+    int workers = 1;
+    int writers = 1;
+    // images waiting between two stages
+    int queueDepth = 2;
+    // bytes of images in flight, from the start of a read to the end of the write
+    size_t memoryLimit = 1024 * 1024 * 1024;
+  };
+
+  struct FileResult {
+    std::filesystem::path file;
+    bool succeeded = false;
+    std::string error;
+    long long pixels = 0;
+  };
+
+  // seconds are summed over the stage's threads
+  struct StageStats {
+    std::string name;
+    int threads = 0;
+    int files = 0;
+    double busySeconds = 0;
+    // waiting for the stage before to hand something on
+    double starvedSeconds = 0;
+    // waiting for a queue, an image or the memory budget to free up
+    double blockedSeconds = 0;
+
+    // fractions of the threads' time over a run that took wallSeconds
+    double busy(double wallSeconds) const;
+    double starved(double wallSeconds) const;
+    double blocked(double wallSeconds) const;
+  };
+
+private:
+  Options options;
+  std::vector<StageStats> stats;
+  double wallSeconds = 0;
+
+public:
+  StagedBatch(const Options& options);
+
+  // writes each file to outputDir under its own name, results are in the same order as files
+  // a file that fails is reported and skipped
+  std::vector<FileResult> run(const std::vector<std::filesystem::path>& files, const std::filesystem::path& outputDir, Pipeline& pipeline);
+
+  // read, process and write, from the last run
+  const std::vector<StageStats>& getStats() const;
+  double getWallSeconds() const;
+  // the stage whose threads were busy the largest fraction of the time
+  const StageStats& bottleneck() const;
+};
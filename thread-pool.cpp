@@ -0,0 +1,121 @@
+#include "thread-pool.h"
+
+ThreadPool::ThreadPool(int numThreads/*=0*/) {
+  startWorkers(numThreads);
+}
+ThreadPool::~ThreadPool() {
+  stopWorkers();
+}
+
+ThreadPool& ThreadPool::shared() {
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::startWorkers(int numThreads) {
+  if (numThreads <= 0) {
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  stopping = false;
+  // the thread calling parallelFor is one of the workers
+  for (int i = 0; i < numThreads - 1; i++) {
+    workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+void ThreadPool::stopWorkers() {
+  {
+    std::lock_guard<std::mutex> lock(jobsMutex);
+    stopping = true;
+  }
+  jobAvailable.notify_all();
+
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  workers.clear();
+}
+
+void ThreadPool::setNumThreads(int numThreads) {
+  stopWorkers();
+  startWorkers(numThreads);
+}
+int ThreadPool::getNumThreads() {
+  return workers.size() + 1;
+}
+
+void ThreadPool::runChunk(Job& job, int chunk) {
+  int begin = chunk * job.chunkSize;
+  int end = std::min(begin + job.chunkSize, job.count);
+  job.func(begin, end);
+
+  if (job.finishedChunks.fetch_add(1) + 1 == job.numChunks) {
+    std::lock_guard<std::mutex> lock(jobsMutex);
+    jobFinished.notify_all();
+  }
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    std::shared_ptr<Job> job;
+    int chunk;
+    {
+      std::unique_lock<std::mutex> lock(jobsMutex);
+      jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+      if (stopping) {
+        return;
+      }
+
+      job = jobs.front();
+      chunk = job->nextChunk.fetch_add(1);
+      if (chunk + 1 >= job->numChunks) {
+        jobs.pop_front();
+      }
+    }
+
+    if (chunk < job->numChunks) {
+      runChunk(*job, chunk);
+    }
+  }
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int, int)>& func, int minChunkSize/*=1*/) {
+  if (count <= 0) {
+    return;
+  }
+
+  // a few chunks per thread evens out uneven rows
+  const int CHUNKS_PER_THREAD = 4;
+  int numThreads = getNumThreads();
+  int chunkSize = std::max(minChunkSize, (count + numThreads * CHUNKS_PER_THREAD - 1) / (numThreads * CHUNKS_PER_THREAD));
+
+  if (numThreads == 1 || chunkSize >= count) {
+    func(0, count);
+    return;
+  }
+
+  auto job = std::make_shared<Job>();
+  job->func = func;
+  job->count = count;
+  job->chunkSize = chunkSize;
+  job->numChunks = (count + chunkSize - 1) / chunkSize;
+
+  {
+    std::lock_guard<std::mutex> lock(jobsMutex);
+    jobs.push_back(job);
+  }
+  jobAvailable.notify_all();
+
+  int chunk;
+  while ((chunk = job->nextChunk.fetch_add(1)) < job->numChunks) {
+    runChunk(*job, chunk);
+  }
+
+  std::unique_lock<std::mutex> lock(jobsMutex);
+  // drops the job if no worker got to it first
+  auto queued = std::find(jobs.begin(), jobs.end(), job);
+  if (queued != jobs.end()) {
+    jobs.erase(queued);
+  }
+  jobFinished.wait(lock, [&job] { return job->finishedChunks.load() == job->numChunks; });
+}
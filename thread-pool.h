@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+// persistent worker threads shared by every PNM filter
+class ThreadPool {
+private:
+  struct Job {
+    std::function<void(int, int)> func;
+    int count;
+    int chunkSize;
+    int numChunks;
+    std::atomic<int> nextChunk{0};
+    std::atomic<int> finishedChunks{0};
+  };
+
+  std::vector<std::thread> workers;
+  std::deque<std::shared_ptr<Job>> jobs;
+  std::mutex jobsMutex;
+  std::condition_variable jobAvailable;
+  std::condition_variable jobFinished;
+  bool stopping = false;
+
+  void startWorkers(int numThreads);
+  void stopWorkers();
+  void workerLoop();
+  void runChunk(Job& job, int chunk);
+
+public:
+  // 0 uses one thread per hardware core
+  ThreadPool(int numThreads=0);
+  ~ThreadPool();
+
+  static ThreadPool& shared();
+
+  void setNumThreads(int numThreads);
+  int getNumThreads();
+
+  // splits [0, count) into contiguous ranges and runs func(begin, end) on them, blocks until all are done
+  // the calling thread works on its own ranges too, so nested calls from inside a worker don't deadlock
+  void parallelFor(int count, const std::function<void(int, int)>& func, int minChunkSize=1);
+};